@@ -0,0 +1,30 @@
+#include "backend.h"
+
+#include <iostream>
+
+#include "xcb_backend.h"
+#include "xinput_backend.h"
+#include "xrecord_backend.h"
+
+
+const char* const BACKEND_NAMES[] = {"xrecord", "xcb", "xinput", "grab"};
+const int BACKEND_COUNT = sizeof(BACKEND_NAMES) / sizeof(BACKEND_NAMES[0]);
+
+std::unique_ptr<Backend> make_backend(const std::string& name) {
+    if (name == "xrecord") {
+        return std::unique_ptr<Backend>(new XRecordBackend());
+    }
+    if (name == "xcb") {
+        return std::unique_ptr<Backend>(new XcbBackend());
+    }
+    if (name == "xinput" || name == "grab") {
+        return std::unique_ptr<Backend>(new XInputBackend());
+    }
+
+    std::cerr << "Unknown backend `" << name << "` (expected one of:";
+    for (int index = 0; index < BACKEND_COUNT; ++index) {
+        std::cerr << ' ' << BACKEND_NAMES[index];
+    }
+    std::cerr << ")." << std::endl;
+    return nullptr;
+}
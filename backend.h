@@ -0,0 +1,69 @@
+#ifndef SPACE2SUPER_BACKEND_H
+#define SPACE2SUPER_BACKEND_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+
+// Receives the input events recorded by a `Backend`.
+class EventSink {
+public:
+    virtual ~EventSink() {}
+
+    // `server_millisec` is the X server time of the event (`CurrentTime`, i.e. 0, if unknown).
+    virtual void record_event(int event_type, KeyCode key_code, std::uint32_t server_millisec) = 0;
+
+    // The key events of a keyboard grabbed by `Backend::grab_keys`, which no other client receives;
+    // each follows the `record_event` call for the same key.
+    virtual void grabbed_event(int event_type, KeyCode key_code, bool repeat) {
+        (void)event_type;
+        (void)key_code;
+        (void)repeat;
+    }
+
+    // Confirms `Backend::request_stop`: no more events will follow.
+    virtual void end_of_data() = 0;
+};
+
+
+// A way of observing the input events of all the X clients.
+class Backend {
+public:
+    virtual ~Backend() {}
+
+    // Opens the connections it needs and starts delivering events into `sink`.
+    virtual bool start(EventSink& sink) = 0;
+
+    // Becomes readable whenever `process` may have events to deliver.
+    virtual int fd() const = 0;
+
+    // Delivers all the events received so far without blocking.
+    virtual void process() = 0;
+
+    // Asks to stop recording; returns false if `EventSink::end_of_data` should not be waited for.
+    virtual bool request_stop() = 0;
+
+    // Intercepts `key_codes` on the physical keyboards with a passive grab: from the press of one of them
+    // till its release, the key events of its keyboard only go to `EventSink::grabbed_event`.
+    // Called after `start`; returns false if the backend cannot (or failed to).
+    virtual bool grab_keys(const std::vector<KeyCode>& key_codes) {
+        (void)key_codes;
+        return false;
+    }
+};
+
+
+// The names of all the backends; the first one is the default.
+// `grab` is `xinput` leaving the keymap alone and grabbing the dual-role keys instead.
+extern const char* const BACKEND_NAMES[];
+extern const int BACKEND_COUNT;
+
+// Returns nullptr (having reported it) if there is no backend called `name`.
+std::unique_ptr<Backend> make_backend(const std::string& name);
+
+
+#endif  // SPACE2SUPER_BACKEND_H
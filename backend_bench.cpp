@@ -0,0 +1,176 @@
+/*
+    Compares the recording backends side by side on the current $DISPLAY:
+    fakes key events of an unmapped key code with XTest on a separate connection and measures
+    the latency until each backend delivers them, as well as the CPU time spent per event.
+
+    Build and run with:
+        make backend-bench
+    Optionally pass the number of events and the backends to compare (all of them by default).
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <time.h>
+
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XTest.h>
+
+#include "backend.h"
+#include "x_error.h"
+
+
+namespace {
+
+typedef std::chrono::steady_clock SteadyClock;
+
+// Gives up on an event not delivered within that.
+const int DELIVERY_TIMEOUT_MILLISEC = 1000;
+
+class CountingSink: public EventSink {
+public:
+    explicit CountingSink(KeyCode key_code): key_code_(key_code) {}
+
+    void record_event(int event_type, KeyCode key_code, std::uint32_t) override {
+        if ((event_type == KEY_PRESS || event_type == KEY_RELEASE) && key_code == key_code_) {
+            ++delivered_;
+        }
+    }
+
+    void end_of_data() override {}
+
+    int delivered() const {
+        return delivered_;
+    }
+
+private:
+    KeyCode key_code_;
+    int delivered_ = 0;
+};
+
+KeyCode find_unmapped_key_code(Display* display) {
+    int min_key_code, max_key_code;
+    XDisplayKeycodes(display, &min_key_code, &max_key_code);
+    for (int key_code = max_key_code; key_code >= min_key_code; --key_code) {
+        if (XkbKeycodeToKeysym(display, static_cast<KeyCode>(key_code), /* group */ 0, /* shift */ 0) == NoSymbol) {
+            return static_cast<KeyCode>(key_code);
+        }
+    }
+    return 0;
+}
+
+double process_cpu_microsec() {
+    timespec cpu_time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+    return cpu_time.tv_sec * 1e6 + cpu_time.tv_nsec / 1e3;
+}
+
+// Waits until the backend has delivered `expected` events in total.
+bool await_delivery(Backend& backend, const CountingSink& sink, int expected) {
+    pollfd source = {backend.fd(), POLLIN, 0};
+    backend.process();
+    while (sink.delivered() < expected) {
+        if (poll(&source, /* nfds */ 1, DELIVERY_TIMEOUT_MILLISEC) <= 0) {
+            return false;
+        }
+        backend.process();
+    }
+    return true;
+}
+
+bool measure(const std::string& name, Display* injection_display, KeyCode key_code, int events) {
+    std::unique_ptr<Backend> backend = make_backend(name);
+    if (backend == nullptr) {
+        return false;
+    }
+
+    CountingSink sink(key_code);
+    if (! backend->start(sink)) {
+        std::cerr << name << ": could not start." << std::endl;
+        return false;
+    }
+    // Let the selection or the record context take effect before injecting.
+    XSync(injection_display, /* discard */ False);
+    backend->process();
+
+    std::vector<double> latencies;
+    latencies.reserve(events);
+    double cpu_start = process_cpu_microsec();
+    for (int event = 0; event < events; ++event) {
+        auto start = SteadyClock::now();
+        XTestFakeKeyEvent(injection_display, key_code, /* is_press */ event % 2 == 0, CurrentTime);
+        XFlush(injection_display);
+        if (! await_delivery(*backend, sink, event + 1)) {
+            std::cerr << name << ": event " << event << " was not delivered." << std::endl;
+            return false;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(SteadyClock::now() - start).count());
+    }
+    double cpu_microsec = process_cpu_microsec() - cpu_start;
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << ": latency p50 " << latencies[latencies.size() / 2] << " us, " <<
+        "p99 " << latencies[latencies.size() * 99 / 100] << " us; " <<
+        "CPU " << cpu_microsec / events << " us/event (including injection)" << std::endl;
+
+    if (backend->request_stop()) {
+        // Drain up to the end of data, so that the next backend starts from a clean state.
+        pollfd source = {backend->fd(), POLLIN, 0};
+        poll(&source, /* nfds */ 1, DELIVERY_TIMEOUT_MILLISEC);
+        backend->process();
+    }
+    return true;
+}
+
+}  // namespace
+
+
+int main(const int argc, const char* argv[]) {
+    int events = argc > 1 ? atoi(argv[1]) : 10000;
+    if (events <= 0) {
+        std::cerr << "The number of events should be positive." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> backends;
+    for (int arg = 2; arg < argc; ++arg) {
+        backends.push_back(argv[arg]);
+    }
+    if (backends.empty()) {
+        backends.assign(BACKEND_NAMES, BACKEND_NAMES + BACKEND_COUNT);
+    }
+
+    XSetErrorHandler(report_x_error);
+
+    Display* display = XOpenDisplay(/* display_name */ nullptr);
+    if (display == nullptr) {
+        std::cerr << "Could not open the default display (not running under X11?)." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int unused;
+    KeyCode key_code = 0;
+    if (! XTestQueryExtension(display, &unused, &unused, &unused, &unused) ||
+        (key_code = find_unmapped_key_code(display)) == 0)
+    {
+        std::cerr << "Faking key events requires XTest and an unmapped key code." << std::endl;
+        XCloseDisplay(display);
+        return EXIT_FAILURE;
+    }
+    std::cout << "Faking " << events << " events of key code " << static_cast<int>(key_code) << std::endl;
+
+    bool success = true;
+    for (const std::string& backend : backends) {
+        success = measure(backend, display, key_code, events) && success;
+    }
+
+    XCloseDisplay(display);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,296 @@
+/*
+    Measures the end-to-end latency of typing a space: starts a private Xvfb server and `space2super`
+    on it, fakes physical-style taps of Space (and, every tenth time, a Super chord) with XTest
+    on a connection of its own, and times from each injected release of Space until a listening client
+    sees the press of the space key code typed by `space2super` (as an XInput 2 raw event).
+    Needs no display or keyboard, only Xvfb (`sudo apt-get install xvfb`), so that builds and backends
+    can be compared on the same machine.
+
+    Build and run with:
+        make e2e-bench
+    Optionally pass the number of taps and the backend (`xrecord` by default; `grab` ignores XTest input
+    and `evdev` needs a real device, so neither can be measured this way).
+    Fails unless every tap typed a space and no chord did.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/XTest.h>
+
+#include "x_error.h"
+
+
+namespace {
+
+typedef std::chrono::steady_clock SteadyClock;
+
+const char* const PROG = "./space2super";
+// As in `DEFAULT_ARGS` in the Makefile: Space is key code 65 in the default Xvfb keymap.
+const KeyCode SPACE = 65;
+const char* const TIMEOUT_MILLISEC = "600";
+const KeyCode LETTER = 38;
+
+// How long Space is down in a tap, and the pause after each tap or chord.
+const int TAP_MILLISEC = 30;
+const int PAUSE_MILLISEC = 20;
+// Gives up on the typed space (or on starting up) after that.
+const int DELIVERY_TIMEOUT_MILLISEC = 1000;
+const int STARTUP_TIMEOUT_MILLISEC = 5000;
+
+void sleep_millisec(int millisec) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(millisec));
+}
+
+// Starts `arguments` with `$DISPLAY` set to `display_name`.
+pid_t spawn(const std::vector<const char*>& arguments, const std::string& display_name) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        setenv("DISPLAY", display_name.c_str(), /* overwrite */ 1);
+        std::vector<char*> argv;
+        for (const char* argument : arguments) {
+            argv.push_back(const_cast<char*>(argument));
+        }
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        std::cerr << "Could not run " << argv[0] << "." << std::endl;
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Terminates the started programs on scope exit, `space2super` first, so that it restores the keymap.
+class Children {
+public:
+    Children() {}
+    Children(const Children&) = delete;
+    Children& operator=(const Children&) = delete;
+
+    ~Children() {
+        for (auto pid = pids_.rbegin(); pid != pids_.rend(); ++pid) {
+            kill(*pid, SIGTERM);
+            waitpid(*pid, nullptr, 0);
+        }
+    }
+
+    bool add(pid_t pid) {
+        if (pid < 0) {
+            return false;
+        }
+        pids_.push_back(pid);
+        return true;
+    }
+
+private:
+    std::vector<pid_t> pids_;
+};
+
+std::string find_free_display() {
+    for (int number = 99; number < 200; ++number) {
+        struct stat unused;
+        if (stat(("/tmp/.X11-unix/X" + std::to_string(number)).c_str(), &unused) != 0 &&
+            stat(("/tmp/.X" + std::to_string(number) + "-lock").c_str(), &unused) != 0)
+        {
+            return ":" + std::to_string(number);
+        }
+    }
+    return "";
+}
+
+Display* open_display(const std::string& display_name) {
+    for (int waited = 0; waited < STARTUP_TIMEOUT_MILLISEC; waited += 50) {
+        if (Display* display = XOpenDisplay(display_name.c_str())) {
+            return display;
+        }
+        sleep_millisec(50);
+    }
+    std::cerr << "Could not connect to Xvfb on " << display_name << "." << std::endl;
+    return nullptr;
+}
+
+// What `key_code` types unshifted, fresh from the server.
+KeySym key_sym(Display* display, KeyCode key_code) {
+    int per_key_code = 0;
+    KeySym* key_syms = XGetKeyboardMapping(display, key_code, 1, &per_key_code);
+    KeySym result = key_syms != nullptr && per_key_code > 0 ? key_syms[0] : NoSymbol;
+    XFree(key_syms);
+    return result;
+}
+
+// Waits for `space2super` to map Space to Super and returns the key code it types the space with.
+KeyCode await_remapping(Display* display) {
+    for (int waited = 0; waited < STARTUP_TIMEOUT_MILLISEC; waited += 50) {
+        if (key_sym(display, SPACE) == XK_Super_L) {
+            int min_key_code, max_key_code;
+            XDisplayKeycodes(display, &min_key_code, &max_key_code);
+            for (int key_code = min_key_code; key_code <= max_key_code; ++key_code) {
+                if (key_code != SPACE && key_sym(display, static_cast<KeyCode>(key_code)) == XK_space) {
+                    return static_cast<KeyCode>(key_code);
+                }
+            }
+        }
+        sleep_millisec(50);
+    }
+    std::cerr << "space2super did not remap Space in time." << std::endl;
+    return 0;
+}
+
+bool listen_to_key_presses(Display* display) {
+    int major = 2, minor = 0;
+    if (XIQueryVersion(display, &major, &minor) != Success) {
+        std::cerr << "XInput 2 is not available." << std::endl;
+        return false;
+    }
+    unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)] = {};
+    XISetMask(mask_bits, XI_RawKeyPress);
+    XIEventMask mask;
+    mask.deviceid = XIAllMasterDevices;
+    mask.mask_len = sizeof(mask_bits);
+    mask.mask = mask_bits;
+    XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+    XSync(display, /* discard */ False);
+    return true;
+}
+
+// Counts the presses of `key_code` seen by the listener until one arrives (or, with `drain`, for the whole
+// `timeout_millisec`).
+int await_key_press(Display* display, KeyCode key_code, int timeout_millisec, bool drain) {
+    int presses = 0;
+    SteadyClock::time_point deadline = SteadyClock::now() + std::chrono::milliseconds(timeout_millisec);
+    pollfd source = {ConnectionNumber(display), POLLIN, 0};
+    for (;;) {
+        while (XPending(display) > 0) {
+            XEvent event;
+            XNextEvent(display, &event);
+            XGenericEventCookie& cookie = event.xcookie;
+            if (cookie.type != GenericEvent || ! XGetEventData(display, &cookie)) {
+                continue;
+            }
+            if (cookie.evtype == XI_RawKeyPress && static_cast<XIRawEvent*>(cookie.data)->detail == key_code) {
+                ++presses;
+            }
+            XFreeEventData(display, &cookie);
+        }
+        if (presses > 0 && ! drain) {
+            return presses;
+        }
+        int remaining = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - SteadyClock::now()).count());
+        if (remaining <= 0 || poll(&source, /* nfds */ 1, remaining) <= 0) {
+            return presses;
+        }
+    }
+}
+
+void fake_key(Display* display, KeyCode key_code, bool is_press) {
+    XTestFakeKeyEvent(display, key_code, is_press ? True : False, CurrentTime);
+    XFlush(display);
+}
+
+double percentile(const std::vector<double>& sorted, int per_mille) {
+    return sorted[std::min(sorted.size() - 1, sorted.size() * per_mille / 1000)];
+}
+
+}  // namespace
+
+
+int main(const int argc, const char* argv[]) {
+    int taps = argc > 1 ? atoi(argv[1]) : 1000;
+    const char* backend = argc > 2 ? argv[2] : "xrecord";
+    if (taps <= 0) {
+        std::cerr << "The number of taps should be positive." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string display_name = find_free_display();
+    Children children;
+    if (display_name.empty() ||
+        ! children.add(spawn({"Xvfb", display_name.c_str(), "-nolisten", "tcp", "-noreset"}, display_name)))
+    {
+        std::cerr << "Could not start Xvfb." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    XSetErrorHandler(report_x_error);
+    Display* injection_display = open_display(display_name);
+    Display* listening_display = injection_display != nullptr ? XOpenDisplay(display_name.c_str()) : nullptr;
+    if (listening_display == nullptr || ! listen_to_key_presses(listening_display)) {
+        return EXIT_FAILURE;
+    }
+    int unused;
+    if (! XTestQueryExtension(injection_display, &unused, &unused, &unused, &unused)) {
+        std::cerr << "Xvfb has no XTest extension." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (! children.add(spawn({PROG, "65", TIMEOUT_MILLISEC, backend}, display_name))) {
+        std::cerr << "Could not start " << PROG << "." << std::endl;
+        return EXIT_FAILURE;
+    }
+    KeyCode space_key_code = await_remapping(injection_display);
+    if (space_key_code == 0) {
+        return EXIT_FAILURE;
+    }
+    // The recording starts right after the remapping.
+    sleep_millisec(200);
+    std::cout << "Tapping Space " << taps << " times with the " << backend << " backend on " << display_name <<
+        " (space typed as key code " << static_cast<int>(space_key_code) << ")" << std::endl;
+
+    std::vector<double> latencies;
+    int lost_spaces = 0, chords = 0, unintended_spaces = 0;
+    for (int tap = 0; tap < taps; ++tap) {
+        if (tap % 10 == 9) {
+            ++chords;
+            fake_key(injection_display, SPACE, true);
+            sleep_millisec(TAP_MILLISEC);
+            fake_key(injection_display, LETTER, true);
+            fake_key(injection_display, LETTER, false);
+            fake_key(injection_display, SPACE, false);
+            unintended_spaces += await_key_press(listening_display, space_key_code, 100, /* drain */ true) > 0;
+            sleep_millisec(PAUSE_MILLISEC);
+        }
+
+        fake_key(injection_display, SPACE, true);
+        sleep_millisec(TAP_MILLISEC);
+        fake_key(injection_display, SPACE, false);
+        SteadyClock::time_point released = SteadyClock::now();
+        if (await_key_press(listening_display, space_key_code, DELIVERY_TIMEOUT_MILLISEC, /* drain */ false) > 0) {
+            latencies.push_back(std::chrono::duration<double, std::micro>(SteadyClock::now() - released).count());
+        } else {
+            ++lost_spaces;
+        }
+        sleep_millisec(PAUSE_MILLISEC);
+    }
+
+    XCloseDisplay(listening_display);
+    XCloseDisplay(injection_display);
+
+    std::cout << "Lost spaces: " << lost_spaces << " of " << taps << "; unintended spaces: " << unintended_spaces <<
+        " of " << chords << " chords" << std::endl;
+    if (latencies.empty()) {
+        return EXIT_FAILURE;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "Release of Space to the typed space: p50 " << percentile(latencies, 500) << " us, " <<
+        "p99 " << percentile(latencies, 990) << " us, p999 " << percentile(latencies, 999) << " us" << std::endl;
+    // The latencies of a run which mistypes are not worth comparing.
+    if (lost_spaces > 0 || unintended_spaces > 0) {
+        std::cerr << "space2super mistyped, see above." << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+#include "engine.h"
+
+#include <cstring>
+
+#include "log.h"
+
+
+#ifndef NDEBUG
+namespace {
+
+const char* yes_or_no(bool value) {
+    return value ? "yes" : "no";
+}
+
+}  // namespace
+#endif
+
+
+Engine::Engine(
+    KeyCode space_key_code, int timeout_millisec, Clock& clock, Output& output, const EngineOptions& options
+):
+    timeout_millisec_(timeout_millisec),
+    rollover_overlap_microsec_(static_cast<Timestamp>(options.rollover_overlap_millisec) * 1000),
+    max_rollover_keys_(options.max_rollover_keys < MAX_ROLLOVER_KEYS ? options.max_rollover_keys : MAX_ROLLOVER_KEYS),
+    typing_streak_microsec_(static_cast<Timestamp>(options.typing_streak_millisec) * 1000),
+    clock_(clock),
+    output_(output)
+{
+    std::memset(slots_, NO_SLOT, sizeof(slots_));
+
+    DualRoleKey space;
+    space.key_code = space_key_code;
+    space.tap = KEY_SYMBOL_SPACE;
+    space.hold = KEY_SYMBOL_SUPER_L;
+    add_key(space, options);
+
+    for (const DualRoleKey& key : options.keys) {
+        add_key(key, options);
+    }
+    space_slot_ = slots_[space_key_code];
+}
+
+void Engine::add_key(DualRoleKey key, const EngineOptions& options) {
+    if (key.timeout_millisec <= 0) {
+        key.timeout_millisec = timeout_millisec_;
+    }
+    if (! key.has_strategy) {
+        key.strategy = options.strategy;
+        key.has_strategy = true;
+    }
+    Timestamp hold_commit_microsec = static_cast<Timestamp>(
+        options.hold_commit_millisec > 0 && options.hold_commit_millisec < key.timeout_millisec ?
+            options.hold_commit_millisec : key.timeout_millisec
+    ) * 1000;
+
+    std::uint8_t slot = slots_[key.key_code];
+    if (slot != NO_SLOT) {
+        // Configured again.
+        keys_[slot] = key;
+        hold_commit_microsec_[slot] = hold_commit_microsec;
+        return;
+    }
+    if (keys_.size() == MAX_KEYS) {
+        return;
+    }
+
+    slot = static_cast<std::uint8_t>(keys_.size());
+    slots_[key.key_code] = slot;
+    keys_.push_back(key);
+    hold_commit_microsec_[slot] = hold_commit_microsec;
+}
+
+bool Engine::rolled_over(KeyCode key_code) const {
+    for (int index = 0; index < rollover_count_; ++index) {
+        if (rollover_keys_[index] == key_code) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Engine::log_state(const char* description) const {
+    (void)description;  // Prevent flagging as unused on NDEBUG.
+    LOG(description << ":" <<
+        "  Active key: " << (active_ >= 0 ? static_cast<int>(keys_[active_].key_code) : 0) <<
+        "  Key combination: " << yes_or_no(key_combo_) <<
+        "  Undecided: " << yes_or_no(undecided()) <<
+        "  Held: " << yes_or_no(active_ >= 0 && states_[active_].held) <<
+        "  Typed: " << yes_or_no(active_ >= 0 && states_[active_].typed)
+    );
+}
+
+void Engine::handle_dual_role_press(int slot, Timestamp time) {
+    LOG("  Dual-role key");
+
+    // One key at a time is undecided: pressing another one makes a combination of both.
+    if (active_ != slot && undecided()) {
+        key_combo_ = true;
+        commit_hold();
+    }
+
+    active_ = slot;
+    states_[slot].down = true;
+    down_moment_ = time_or_now(time);
+    key_combo_ = down_buttons_ != 0 || down_keys_.any_but(keys_[slot].key_code);
+    rollover_count_ = 0;
+
+    if (slot == space_slot_ && typing_streak(down_moment_)) {
+        LOG("  Pressed " << (down_moment_ - last_key_press_) << " us after another key");
+        states_[slot].typed = true;
+        output_.tap(keys_[slot]);
+    } else {
+        output_.schedule_hold(hold_commit_microsec_[slot]);
+    }
+}
+
+void Engine::handle_dual_role_release(int slot, Timestamp time) {
+    KeyState& state = states_[slot];
+
+    if (slot != active_ && undecided()) {
+        // Pressed before the active key.
+        handle_earlier_release();
+    }
+
+    if (slot == active_ && undecided()) {
+        output_.cancel_hold();
+        // The scheduled call may still be on its way if the release came just in time.
+        Timestamp now = time_or_now(time);
+        expire_hold(now);
+        if (undecided() && rollover_count_ > 0 && rollover_overlap_microsec_ > 0 &&
+            now > rollover_start_ && now - rollover_start_ > rollover_overlap_microsec_)
+        {
+            LOG("  Down together with another key for " << (now - rollover_start_) << " us");
+            commit_hold();
+        }
+
+        if (undecided()) {
+            LOG("  Released within the limit of " << keys_[slot].timeout_millisec << " ms");
+            output_.tap(keys_[slot]);
+        }
+    }
+
+    if (state.held) {
+        output_.release_hold(keys_[slot]);
+    }
+
+    state = KeyState();
+    if (slot == active_) {
+        active_ = -1;
+        key_combo_ = false;
+        rollover_count_ = 0;
+    }
+}
+
+void Engine::handle_key_press(KeyCode key_code, Timestamp time) {
+    last_key_press_ = time_or_now(time);
+    if (active_ < 0) {
+        return;
+    }
+
+    key_combo_ = true;
+    if (undecided() && keys_[active_].strategy != HOLD_ON_OTHER_KEY_PRESS && rollover_count_ < max_rollover_keys_) {
+        LOG("  Rolled over from the dual-role key, undecided until either is released");
+        if (rollover_count_ == 0) {
+            rollover_start_ = last_key_press_;
+        }
+        rollover_keys_[rollover_count_++] = key_code;
+    } else {
+        commit_hold();
+    }
+}
+
+void Engine::handle_key_release(KeyCode key_code) {
+    if (undecided() && keys_[active_].strategy == PERMISSIVE_HOLD && rolled_over(key_code)) {
+        LOG("  Pressed and released while the dual-role key is down");
+        commit_hold();
+    } else if (undecided() && modifier_keys_.contains(key_code) && down_keys_.contains(key_code) &&
+        ! rolled_over(key_code))
+    {
+        // Down but not rolled over, so pressed before the dual-role key
+        // (keys pressed after it roll over or make it held).
+        handle_earlier_release();
+    }
+}
+
+void Engine::handle_button_press(unsigned button) {
+    LOG("ButtonPress");
+    if (button < 32) {
+        down_buttons_ |= std::uint32_t(1) << button;
+    }
+    // Not typing anymore.
+    last_key_press_ = NO_TIME;
+    if (active_ >= 0) {
+        key_combo_ = true;
+        commit_hold();
+    }
+}
+
+void Engine::handle_button_release(unsigned button) {
+    LOG("ButtonRelease");
+    if (button >= 32 || ! (down_buttons_ & (std::uint32_t(1) << button))) {
+        return;
+    }
+    // A button pressed meanwhile would have made the key held.
+    if (undecided()) {
+        handle_earlier_release();
+    }
+    down_buttons_ &= ~(std::uint32_t(1) << button);
+}
+
+void Engine::handle_earlier_release() {
+    if (keys_[active_].strategy == TAP_PREFERRED) {
+        return;
+    }
+    LOG("  Released a modifier or button pressed before the dual-role key");
+    key_combo_ = true;
+    commit_hold();
+}
+
+void Engine::expire_hold(Timestamp time) {
+    if (undecided() && time > down_moment_ && time - down_moment_ > hold_commit_microsec_[active_]) {
+        LOG("  " << (time - down_moment_) << " us passed since the dual-role key was pressed");
+        commit_hold();
+    }
+}
+
+void Engine::commit_hold() {
+    if (! undecided()) {
+        return;
+    }
+    LOG("  Held");
+    states_[active_].held = true;
+    rollover_count_ = 0;
+    output_.cancel_hold();
+    output_.hold(keys_[active_]);
+}
+
+void Engine::process_event(int event_type, KeyCode key_code, Timestamp time) {
+    switch (event_type) {
+    case KEY_PRESS:
+    case KEY_RELEASE:
+    case BUTTON_PRESS:
+    case BUTTON_RELEASE:
+        LOG("");  // Separate event reports with blank lines.
+        log_state("State before");
+        if (time != NO_TIME) {
+            expire_hold(time);
+        }
+        break;
+    default:
+        return;
+    }
+
+    std::uint8_t slot = slots_[key_code];
+    switch (event_type) {
+    case KEY_PRESS:
+        LOG("KeyPress");
+        if (down_keys_.contains(key_code)) {
+            // Pressing a dual-role key again would restart its timeout.
+            LOG("  Autorepeat, ignored");
+            ++suppressed_repeats_;
+            break;
+        }
+        down_keys_.set(key_code, true);
+        if (slot != NO_SLOT) {
+            handle_dual_role_press(slot, time);
+        } else {
+            handle_key_press(key_code, time);
+        }
+        break;
+    case KEY_RELEASE:
+        LOG("KeyRelease");
+        if (slot != NO_SLOT) {
+            handle_dual_role_release(slot, time);
+        } else {
+            handle_key_release(key_code);
+        }
+        down_keys_.set(key_code, false);
+        break;
+    case BUTTON_PRESS:
+        handle_button_press(key_code);
+        break;
+    case BUTTON_RELEASE:
+        handle_button_release(key_code);
+        break;
+    }
+
+    LOG("  Key code: " << static_cast<int>(key_code));
+
+    log_state("State after ");  // An additional space to align with "before".
+}
@@ -0,0 +1,305 @@
+#ifndef SPACE2SUPER_ENGINE_H
+#define SPACE2SUPER_ENGINE_H
+
+/*
+    The Space2Super tap-vs-hold decision engine.
+
+    It knows nothing about X11: time comes from an injected `Clock` and decisions leave through
+    an injected `Output`, so the same logic runs under the X adapter (`space2super.cpp`)
+    and headlessly under trace replays and benchmarks (`engine_check.cpp`).
+
+    Space (acting as Super when held) is the original dual-role key; more can be configured
+    (see `DualRoleKey`), all dispatched by key code through one table.
+*/
+
+#include <cstdint>
+#include <vector>
+
+#include "keysyms.h"
+
+
+// Same as in X11/X.h (so both can be included together).
+typedef unsigned char KeyCode;
+
+// Microseconds on an arbitrary monotonic scale.
+typedef std::uint64_t Timestamp;
+
+// Marks events which carry no timestamp of their own; the engine then asks its `Clock`.
+const Timestamp NO_TIME = 0;
+
+// The values match the X core protocol event codes (`KeyPress` etc. in X11/X.h),
+// so X backends can pass the raw event type through.
+enum EventType {
+    KEY_PRESS = 2,
+    KEY_RELEASE = 3,
+    BUTTON_PRESS = 4,
+    BUTTON_RELEASE = 5,
+};
+
+
+// How an undecided dual-role key is resolved when other keys are pressed meanwhile.
+// Without them, the key released within its timeout is tapped, and held past it is held.
+enum TapHoldStrategy {
+    // The key is held from that press on.
+    HOLD_ON_OTHER_KEY_PRESS,
+    // The key is held once that other key is released while it is down (a nested chord).
+    // Released first, the key is tapped: the typist has rolled over from it to the next letter.
+    PERMISSIVE_HOLD,
+    // Only time decides: the key released within its timeout is tapped, whatever was pressed meanwhile.
+    TAP_PREFERRED,
+};
+
+// A key which types one keysym when tapped alone and acts as another (usually a modifier) when held.
+struct DualRoleKey {
+    KeyCode key_code = 0;
+    KeySymbol tap = NO_KEY_SYMBOL;
+    KeySymbol hold = NO_KEY_SYMBOL;
+    // The maximum amount of milliseconds during which the key can be pressed to be tapped;
+    // 0 for the engine timeout.
+    int timeout_millisec = 0;
+    // Otherwise `EngineOptions::strategy` applies.
+    bool has_strategy = false;
+    TapHoldStrategy strategy = HOLD_ON_OTHER_KEY_PRESS;
+};
+
+// The engine tunables besides the Space key code and the timeout, see `parse_engine_option`.
+struct EngineOptions {
+    // The default for all dual-role keys.
+    TapHoldStrategy strategy = HOLD_ON_OTHER_KEY_PRESS;
+    // An undecided key pressed alone for that long is held; at most (and by default, with 0) its timeout.
+    // A shorter threshold commits the hold earlier for chords at the expense of slow taps.
+    int hold_commit_millisec = 0;
+    // Keys pressed while a dual-role key is undecided are said to roll over from it
+    // (unless the strategy is `HOLD_ON_OTHER_KEY_PRESS`).
+    // Both down together for longer than that make the dual-role key held even if it is released first;
+    // 0 for no limit besides the timeout.
+    int rollover_overlap_millisec = 0;
+    // One more key rolling over makes the dual-role key held.
+    int max_rollover_keys = 8;
+    // Space pressed within that after another key (i.e. in the middle of typing) is typed right away,
+    // without waiting for its release; 0 to always wait.
+    int typing_streak_millisec = 0;
+    // Besides Space; an entry for the Space key code replaces the default one.
+    std::vector<DualRoleKey> keys;
+};
+
+
+// The fallback time source for events without timestamps.
+class Clock {
+public:
+    virtual ~Clock() {}
+
+    virtual Timestamp now() = 0;
+};
+
+
+class Output {
+public:
+    virtual ~Output() {}
+
+    // The key has been tapped alone: its `tap` keysym should be typed.
+    virtual void tap(const DualRoleKey& key) = 0;
+
+    // The key has been decided to act as its `hold` keysym until released.
+    // Keys held back (see `Engine::holding_back`) should be released right after this and `tap`.
+    virtual void hold(const DualRoleKey& key) {
+        (void)key;
+    }
+
+    // The key has been released after `hold`.
+    virtual void release_hold(const DualRoleKey& key) {
+        (void)key;
+    }
+
+    // Asks to call `Engine::commit_hold` in `microseconds` (replacing any earlier request).
+    virtual void schedule_hold(Timestamp microseconds) {
+        (void)microseconds;
+    }
+
+    // Revokes `schedule_hold`.
+    virtual void cancel_hold() {}
+};
+
+
+class Engine {
+public:
+    // Space types `space` and acts as `Super_L`, unless `options.keys` says otherwise.
+    Engine(KeyCode space_key_code, int timeout_millisec, Clock& clock, Output& output,
+        const EngineOptions& options = EngineOptions());
+
+    // Events of types other than `EventType` values are ignored.
+    // For button events, `key_code` is the button number.
+    // `time` should preferably come from the event itself (e.g. the X server time) so that
+    // the delivery lag does not count towards the hold duration; a backend should stick to
+    // one source, since timestamps from the event and from the `Clock` are not comparable.
+    void process_event(int event_type, KeyCode key_code, Timestamp time);
+
+    // Decides that the undecided key is held once the time scheduled on its press has elapsed,
+    // so that the decision latency is bounded by that rather than by the release.
+    void commit_hold();
+
+    // Whether keys have rolled over from the undecided key (see `EngineOptions`).
+    // A backend which can delay events should then hold the current one and all the later ones back
+    // until that key is decided upon, so that a tap comes out before them.
+    bool holding_back() const {
+        return rollover_count_ > 0 && undecided();
+    }
+
+    // Marks the key codes of modifiers (Control etc.), which make a chord with a dual-role key
+    // when released while it is undecided after being pressed before it (as opposed to the previous letter
+    // still being released when typing fast). The key codes of dual-role keys need not be marked.
+    void set_modifier_key(KeyCode key_code, bool modifier) {
+        modifier_keys_.set(key_code, modifier);
+    }
+
+    // With the timeouts and strategies resolved.
+    const std::vector<DualRoleKey>& dual_role_keys() const {
+        return keys_;
+    }
+
+    // Returns nullptr for ordinary keys.
+    const DualRoleKey* dual_role_key(KeyCode key_code) const {
+        return slots_[key_code] != NO_SLOT ? &keys_[slots_[key_code]] : nullptr;
+    }
+
+    bool space_down() const {
+        return states_[space_slot_].down;
+    }
+
+    bool space_key_combo() const {
+        return active_ == space_slot_ && key_combo_;
+    }
+
+    bool space_held() const {
+        return states_[space_slot_].held;
+    }
+
+    // Presses of keys already down, i.e. autorepeat, which are ignored
+    // (other than letting the time pass for `commit_hold`).
+    std::uint64_t suppressed_repeats() const {
+        return suppressed_repeats_;
+    }
+
+private:
+    struct KeyState {
+        // Whether the key is pressed.
+        bool down = false;
+        // Whether the key has been decided to be held (after a combination or the timeout),
+        // i.e. it will not be tapped on release.
+        bool held = false;
+        // Whether the key has been tapped on press (Space during a typing streak).
+        bool typed = false;
+    };
+
+    class KeyCodeSet {
+    public:
+        bool contains(KeyCode key_code) const {
+            return (words_[key_code >> 6] >> (key_code & 63)) & 1;
+        }
+
+        void set(KeyCode key_code, bool contained) {
+            std::uint64_t bit = std::uint64_t(1) << (key_code & 63);
+            std::uint64_t& word = words_[key_code >> 6];
+            word = contained ? word | bit : word & ~bit;
+        }
+
+        // Whether there are any besides `key_code`.
+        bool any_but(KeyCode key_code) const {
+            std::uint64_t own = std::uint64_t(1) << (key_code & 63);
+            std::uint64_t others = 0;
+            for (int index = 0; index < 4; ++index) {
+                others |= words_[index] & ~(index == key_code >> 6 ? own : 0);
+            }
+            return others != 0;
+        }
+
+    private:
+        std::uint64_t words_[4] = {};
+    };
+
+    static const int MAX_KEYS = 32;
+    static const std::uint8_t NO_SLOT = 0xff;
+
+private:
+    // Indices into `keys_` (and `states_` etc.) by key code, or `NO_SLOT`,
+    // so that every event is dispatched in constant time.
+    std::uint8_t slots_[256];
+    std::vector<DualRoleKey> keys_;
+    KeyState states_[MAX_KEYS];
+    // When an undecided press is held, at most the timeout.
+    Timestamp hold_commit_microsec_[MAX_KEYS];
+    int space_slot_ = 0;
+
+    // For the keys without a timeout of their own.
+    int timeout_millisec_;
+
+    Timestamp rollover_overlap_microsec_;
+    int max_rollover_keys_;
+    Timestamp typing_streak_microsec_;
+
+    Clock& clock_;
+    Output& output_;
+
+    // All the keys and buttons (1 to 31) currently down, whatever happened while they were,
+    // so that chords with keys pressed before a dual-role key are told apart in constant time.
+    KeyCodeSet down_keys_;
+    std::uint32_t down_buttons_ = 0;
+    std::uint64_t suppressed_repeats_ = 0;
+    // See `set_modifier_key`.
+    KeyCodeSet modifier_keys_;
+
+    // The dual-role key pressed last, if it is still down; at most this one is undecided.
+    int active_ = -1;
+    // If any, indicates when its `KeyPress` event happened.
+    Timestamp down_moment_ = 0;
+
+    // Whether the active key is pressed simultaneously with some other keys or buttons
+    // (including ones already down before it).
+    bool key_combo_ = false;
+
+    // When another key was last pressed, if there has been no button press since.
+    Timestamp last_key_press_ = NO_TIME;
+
+    // The keys pressed while the active key is undecided.
+    static const int MAX_ROLLOVER_KEYS = 16;
+    KeyCode rollover_keys_[MAX_ROLLOVER_KEYS];
+    int rollover_count_ = 0;
+    // When the first of them was pressed.
+    Timestamp rollover_start_ = 0;
+
+private:
+    void add_key(DualRoleKey key, const EngineOptions& options);
+
+    bool undecided() const {
+        return active_ >= 0 && ! states_[active_].held && ! states_[active_].typed;
+    }
+
+    bool typing_streak(Timestamp time) const {
+        return typing_streak_microsec_ > 0 && last_key_press_ != NO_TIME &&
+            time >= last_key_press_ && time - last_key_press_ <= typing_streak_microsec_;
+    }
+
+    // Commits the hold if the event `time` is past the hold commit threshold (when the scheduled call is late).
+    void expire_hold(Timestamp time);
+
+    bool rolled_over(KeyCode key_code) const;
+
+    // A modifier or button down before the undecided key and released while it is down makes a chord with it.
+    void handle_earlier_release();
+
+    void log_state(const char* description) const;
+
+    Timestamp time_or_now(Timestamp time) {
+        return time != NO_TIME ? time : clock_.now();
+    }
+
+    void handle_dual_role_press(int slot, Timestamp time);
+    void handle_dual_role_release(int slot, Timestamp time);
+    void handle_key_press(KeyCode key_code, Timestamp time);
+    void handle_key_release(KeyCode key_code);
+    void handle_button_press(unsigned button);
+    void handle_button_release(unsigned button);
+};
+
+
+#endif  // SPACE2SUPER_ENGINE_H
@@ -0,0 +1,328 @@
+/*
+    Measures the event hot path of the daemons, i.e. extending the X server time and
+    `Engine::process_event` (with the hold timer going off when due), on generated event mixes:
+    typing, Super chords, Space with mouse clicks, and autorepeat storms during holds.
+    Each mix is replayed once to warm up and then `REPETITIONS` times, reporting per event
+    the median and the spread of the time, the instructions retired (where the kernel lets
+    `perf_event_open` count them) and the heap allocations.
+
+    Build and run with:
+        make bench
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "server_time.h"
+
+
+namespace {
+
+const KeyCode SPACE = 65;
+const KeyCode FIRST_LETTER = 24;
+const KeyCode CONTROL = 37;
+const int TIMEOUT_MILLISEC = 600;
+
+// About a million events in each mix.
+const int EVENTS = 1000000;
+const int REPETITIONS = 15;
+
+// Counted by the replaced `operator new`.
+std::uint64_t allocations = 0;
+
+struct BenchEvent {
+    int type;
+    KeyCode key_code;
+    // The X server time.
+    std::uint32_t millisec;
+};
+
+class Mix {
+public:
+    explicit Mix(const char* name): name(name) {}
+
+    void add(int type, KeyCode key_code, int after_millisec) {
+        millisec_ += static_cast<std::uint32_t>(after_millisec);
+        events.push_back({type, key_code, millisec_});
+    }
+
+    const char* name;
+    std::vector<BenchEvent> events;
+
+private:
+    std::uint32_t millisec_ = 0;
+};
+
+class BenchOutput: public Clock, public Output {
+public:
+    Timestamp now() override {
+        return now_;
+    }
+
+    void tap(const DualRoleKey&) override {
+        ++decisions_;
+    }
+
+    void hold(const DualRoleKey&) override {
+        ++decisions_;
+    }
+
+    void schedule_hold(Timestamp microseconds) override {
+        hold_deadline_ = now_ + microseconds;
+    }
+
+    void cancel_hold() override {
+        hold_deadline_ = NO_TIME;
+    }
+
+    void set_now(Timestamp moment) {
+        now_ = moment;
+    }
+
+    Timestamp hold_deadline() const {
+        return hold_deadline_;
+    }
+
+    std::uint64_t decisions() const {
+        return decisions_;
+    }
+
+private:
+    Timestamp now_ = 0;
+    Timestamp hold_deadline_ = NO_TIME;
+    std::uint64_t decisions_ = 0;
+};
+
+// Counts the instructions retired in user space by this thread, if allowed.
+class InstructionCounter {
+public:
+    InstructionCounter() {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attributes, /* pid */ 0, /* cpu */ -1, /* group_fd */ -1, 0));
+    }
+
+    InstructionCounter(const InstructionCounter&) = delete;
+    InstructionCounter& operator=(const InstructionCounter&) = delete;
+
+    ~InstructionCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool available() const {
+        return fd_ >= 0;
+    }
+
+    void start() {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    std::uint64_t stop() {
+        std::uint64_t count = 0;
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+        return count;
+    }
+
+private:
+    int fd_;
+};
+
+// Words of letters and spaces, the next word often starting before Space is released.
+Mix typing_mix() {
+    Mix mix("typing");
+    std::minstd_rand random(1);
+    while (mix.events.size() < EVENTS) {
+        for (int letter = 0; letter < 5; ++letter) {
+            KeyCode key_code = static_cast<KeyCode>(FIRST_LETTER + random() % 26);
+            mix.add(KEY_PRESS, key_code, 30 + random() % 60);
+            mix.add(KEY_RELEASE, key_code, 40 + random() % 60);
+        }
+        mix.add(KEY_PRESS, SPACE, 30 + random() % 60);
+        if (random() % 2) {
+            KeyCode key_code = static_cast<KeyCode>(FIRST_LETTER + random() % 26);
+            mix.add(KEY_PRESS, key_code, 30 + random() % 40);
+            mix.add(KEY_RELEASE, SPACE, 10 + random() % 40);
+            mix.add(KEY_RELEASE, key_code, 30 + random() % 40);
+        } else {
+            mix.add(KEY_RELEASE, SPACE, 60 + random() % 60);
+        }
+    }
+    return mix;
+}
+
+// Super and Control+Super chords with one to three keys.
+Mix chord_mix() {
+    Mix mix("chords");
+    std::minstd_rand random(2);
+    while (mix.events.size() < EVENTS) {
+        bool control = random() % 3 == 0;
+        if (control) {
+            mix.add(KEY_PRESS, CONTROL, 300);
+        }
+        mix.add(KEY_PRESS, SPACE, control ? 50 : 300);
+        for (unsigned key = 0, keys = 1 + random() % 3; key < keys; ++key) {
+            KeyCode key_code = static_cast<KeyCode>(FIRST_LETTER + random() % 26);
+            mix.add(KEY_PRESS, key_code, 100 + random() % 200);
+            mix.add(KEY_RELEASE, key_code, 50 + random() % 50);
+        }
+        mix.add(KEY_RELEASE, SPACE, 50 + random() % 100);
+        if (control) {
+            mix.add(KEY_RELEASE, CONTROL, 50);
+        }
+    }
+    return mix;
+}
+
+// Clicks and drags with Space held, and clicks between spaces.
+Mix mouse_mix() {
+    Mix mix("mouse combos");
+    std::minstd_rand random(3);
+    while (mix.events.size() < EVENTS) {
+        KeyCode button = static_cast<KeyCode>(1 + random() % 3);
+        if (random() % 2) {
+            mix.add(KEY_PRESS, SPACE, 300);
+            mix.add(BUTTON_PRESS, button, 100 + random() % 300);
+            mix.add(BUTTON_RELEASE, button, 50 + random() % 500);
+            mix.add(KEY_RELEASE, SPACE, 50 + random() % 100);
+        } else {
+            mix.add(BUTTON_PRESS, button, 300);
+            mix.add(BUTTON_RELEASE, button, 80);
+            mix.add(KEY_PRESS, SPACE, 200);
+            mix.add(KEY_RELEASE, SPACE, 60 + random() % 60);
+        }
+    }
+    return mix;
+}
+
+// Space held past the timeout while it and a key held with it autorepeat at about 30 Hz each.
+Mix autorepeat_mix() {
+    Mix mix("autorepeat storms");
+    std::minstd_rand random(4);
+    while (mix.events.size() < EVENTS) {
+        KeyCode key_code = static_cast<KeyCode>(FIRST_LETTER + random() % 26);
+        mix.add(KEY_PRESS, SPACE, 300);
+        for (int repeat = 0; repeat < 20; ++repeat) {
+            mix.add(KEY_PRESS, SPACE, 33);
+        }
+        mix.add(KEY_PRESS, key_code, 20);
+        for (int repeat = 0; repeat < 40; ++repeat) {
+            mix.add(KEY_PRESS, repeat % 2 ? SPACE : key_code, 16);
+        }
+        mix.add(KEY_RELEASE, key_code, 20);
+        mix.add(KEY_RELEASE, SPACE, 50);
+    }
+    return mix;
+}
+
+// The daemons' `record_event`, minus the recording.
+std::uint64_t replay(const Mix& mix, Engine& engine, BenchOutput& output, ServerTime& server_time) {
+    for (const BenchEvent& event : mix.events) {
+        Timestamp time = server_time.extend(event.millisec);
+        if (output.hold_deadline() != NO_TIME && output.hold_deadline() < time) {
+            output.set_now(output.hold_deadline());
+            engine.commit_hold();
+        }
+        output.set_now(time);
+        engine.process_event(event.type, event.key_code, time);
+    }
+    return output.decisions();
+}
+
+void measure(const Mix& mix, InstructionCounter& instructions) {
+    BenchOutput output;
+    Engine engine(SPACE, TIMEOUT_MILLISEC, output, output);
+    engine.set_modifier_key(CONTROL, true);
+    ServerTime server_time;
+
+    // Also faults the events in and lets the CPU settle on its frequency.
+    replay(mix, engine, output, server_time);
+
+    std::vector<double> nanoseconds;
+    std::uint64_t instruction_count = 0;
+    std::uint64_t allocation_count = 0;
+    for (int repetition = 0; repetition < REPETITIONS; ++repetition) {
+        std::uint64_t allocations_before = allocations;
+        instructions.start();
+        auto start = std::chrono::steady_clock::now();
+        replay(mix, engine, output, server_time);
+        auto end = std::chrono::steady_clock::now();
+        instruction_count += instructions.stop();
+        allocation_count += allocations - allocations_before;
+        nanoseconds.push_back(std::chrono::duration<double, std::nano>(end - start).count() / mix.events.size());
+    }
+
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+    double median = nanoseconds[REPETITIONS / 2];
+    std::vector<double> deviations;
+    for (double value : nanoseconds) {
+        deviations.push_back(std::abs(value - median));
+    }
+    std::sort(deviations.begin(), deviations.end());
+    double total_events = static_cast<double>(mix.events.size()) * REPETITIONS;
+
+    std::cout << std::left << std::setw(20) << mix.name << std::right << std::fixed << std::setprecision(2) <<
+        std::setw(8) << median << " ns/event (+-" << std::setprecision(1) <<
+        100 * deviations[REPETITIONS / 2] / median << "%, min " << std::setprecision(2) << nanoseconds.front() << "), ";
+    if (instructions.available()) {
+        std::cout << std::setprecision(1) << instruction_count / total_events << " instructions/event, ";
+    } else {
+        std::cout << "instructions n/a, ";
+    }
+    std::cout << std::setprecision(3) << allocation_count / total_events << " allocations/event" << std::endl;
+}
+
+}  // namespace
+
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+int main() {
+    InstructionCounter instructions;
+    std::cout << "Median of " << REPETITIONS << " replays of about " << EVENTS << " events after a warmup" <<
+        (instructions.available() ? "" : " (instruction counts not permitted here)") << ":" << std::endl;
+    for (const Mix& mix : {typing_mix(), chord_mix(), mouse_mix(), autorepeat_mix()}) {
+        measure(mix, instructions);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,698 @@
+/*
+    Replays scripted event traces through `Engine` without an X server,
+    checking the typed spaces against expectations and measuring the replay throughput.
+
+    Build and run with:
+        make check
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "engine.h"
+#include "server_time.h"
+#include "spsc_queue.h"
+#include "trace.h"
+#include "trace_replay.h"
+
+
+namespace {
+
+const KeyCode SPACE = 65;
+const KeyCode LETTER = 38;
+const KeyCode CONTROL = 37;
+const KeyCode CAPS_LOCK = 66;
+const int CAPS_LOCK_TIMEOUT_MILLISEC = 200;
+const int TIMEOUT_MILLISEC = 600;
+
+// A trace event type standing for the hold timer scheduled by the engine going off.
+const int HOLD_TIMER = -1;
+
+// Trace options.
+// The events carry no timestamps, so that the engine falls back to its clock.
+const int UNTIMED = 1;
+// With `PERMISSIVE_HOLD` (and up to `MAX_ROLLOVER_KEYS` rolled over keys).
+const int PERMISSIVE = 2;
+// With `PERMISSIVE_HOLD` limited to `ROLLOVER_OVERLAP_MILLISEC`.
+const int ROLLOVER_OVERLAP = 4;
+// Typing spaces on press within `TYPING_STREAK_MILLISEC` after another key.
+const int TYPING_STREAK = 8;
+// With `TAP_PREFERRED`.
+const int TAP_PREFERENCE = 16;
+// Holding Space after `HOLD_COMMIT_MILLISEC` instead of the timeout.
+const int EARLY_HOLD = 32;
+// With `CAPS_LOCK` typing Escape and acting as Control within `CAPS_LOCK_TIMEOUT_MILLISEC`.
+const int CAPS_LOCK_DUAL_ROLE = 64;
+
+const int MAX_ROLLOVER_KEYS = 2;
+const int ROLLOVER_OVERLAP_MILLISEC = 100;
+const int TYPING_STREAK_MILLISEC = 150;
+const int HOLD_COMMIT_MILLISEC = 200;
+
+struct TraceEvent {
+    int millisec;
+    int type;
+    KeyCode key_code;
+};
+
+struct Trace {
+    Trace(
+        const char* name, std::vector<TraceEvent> events, int expected_spaces, int options = 0,
+        int expected_other_taps = 0
+    ):
+        name(name), events(std::move(events)), expected_spaces(expected_spaces), options(options),
+        expected_other_taps(expected_other_taps)
+    {
+    }
+
+    const char* name;
+    std::vector<TraceEvent> events;
+    int expected_spaces;
+    int options;
+    // Of the dual-role keys other than Space.
+    int expected_other_taps;
+};
+
+// A clock which only moves when told so.
+class TraceClock: public Clock {
+public:
+    Timestamp now() override {
+        return now_;
+    }
+
+    void set(Timestamp moment) {
+        now_ = moment;
+    }
+
+private:
+    Timestamp now_ = 0;
+};
+
+class CountingOutput: public Output {
+public:
+    explicit CountingOutput(Clock& clock): clock_(clock) {}
+
+    void tap(const DualRoleKey& key) override {
+        if (key.tap == KEY_SYMBOL_SPACE) {
+            ++spaces_;
+            last_space_time_ = clock_.now();
+        } else {
+            ++other_taps_;
+        }
+        decide();
+    }
+
+    void hold(const DualRoleKey&) override {
+        decide();
+    }
+
+    void schedule_hold(Timestamp microseconds) override {
+        hold_deadline_ = clock_.now() + microseconds;
+    }
+
+    void cancel_hold() override {
+        hold_deadline_ = NO_TIME;
+    }
+
+    // When the scheduled hold timer goes off, if it is armed.
+    Timestamp hold_deadline() const {
+        return hold_deadline_;
+    }
+
+    int spaces() const {
+        return spaces_;
+    }
+
+    // Of the dual-role keys other than Space.
+    int other_taps() const {
+        return other_taps_;
+    }
+
+    Timestamp last_space_time() const {
+        return last_space_time_;
+    }
+
+    // When Space was first decided upon.
+    Timestamp decision_time() const {
+        return decision_time_;
+    }
+
+private:
+    void decide() {
+        if (decision_time_ == NO_TIME) {
+            decision_time_ = clock_.now();
+        }
+    }
+
+private:
+    Clock& clock_;
+    int spaces_ = 0;
+    int other_taps_ = 0;
+    Timestamp last_space_time_ = NO_TIME;
+    Timestamp decision_time_ = NO_TIME;
+    Timestamp hold_deadline_ = NO_TIME;
+};
+
+EngineOptions engine_options(int trace_options) {
+    EngineOptions options;
+    options.max_rollover_keys = MAX_ROLLOVER_KEYS;
+    if (trace_options & (PERMISSIVE | ROLLOVER_OVERLAP)) {
+        options.strategy = PERMISSIVE_HOLD;
+    }
+    if (trace_options & TAP_PREFERENCE) {
+        options.strategy = TAP_PREFERRED;
+    }
+    if (trace_options & EARLY_HOLD) {
+        options.hold_commit_millisec = HOLD_COMMIT_MILLISEC;
+    }
+    if (trace_options & ROLLOVER_OVERLAP) {
+        options.rollover_overlap_millisec = ROLLOVER_OVERLAP_MILLISEC;
+    }
+    if (trace_options & CAPS_LOCK_DUAL_ROLE) {
+        DualRoleKey caps_lock;
+        caps_lock.key_code = CAPS_LOCK;
+        caps_lock.tap = KEY_SYMBOL_ESCAPE;
+        caps_lock.hold = KEY_SYMBOL_CONTROL_L;
+        caps_lock.timeout_millisec = CAPS_LOCK_TIMEOUT_MILLISEC;
+        options.keys.push_back(caps_lock);
+    }
+    if (trace_options & TYPING_STREAK) {
+        options.typing_streak_millisec = TYPING_STREAK_MILLISEC;
+    }
+    return options;
+}
+
+struct ReplayResult {
+    int spaces;
+    int other_taps;
+    // When the last space was typed.
+    int last_space_millisec;
+    // When Space was first decided upon.
+    int decision_millisec;
+};
+
+ReplayResult replay(const Trace& trace) {
+    TraceClock clock;
+    CountingOutput output(clock);
+    Engine engine(SPACE, TIMEOUT_MILLISEC, clock, output, engine_options(trace.options));
+    engine.set_modifier_key(CONTROL, true);
+
+    for (const TraceEvent& event : trace.events) {
+        Timestamp time = static_cast<Timestamp>(event.millisec) * 1000;
+        // The hold timer goes off on its own, too (`HOLD_TIMER` also covers a late one).
+        if (output.hold_deadline() != NO_TIME && output.hold_deadline() < time) {
+            clock.set(output.hold_deadline());
+            engine.commit_hold();
+        }
+        clock.set(time);
+        if (event.type == HOLD_TIMER) {
+            engine.commit_hold();
+        } else {
+            engine.process_event(event.type, event.key_code, (trace.options & UNTIMED) ? NO_TIME : time);
+        }
+    }
+    return {
+        output.spaces(),
+        output.other_taps(),
+        static_cast<int>(output.last_space_time() / 1000),
+        static_cast<int>(output.decision_time() / 1000),
+    };
+}
+
+const std::vector<Trace>& traces() {
+    static const std::vector<Trace> all = {
+        {"tap", {
+            {0, KEY_PRESS, SPACE}, {80, KEY_RELEASE, SPACE},
+        }, 1},
+        {"tap at the timeout", {
+            {0, KEY_PRESS, SPACE}, {TIMEOUT_MILLISEC, KEY_RELEASE, SPACE},
+        }, 1},
+        {"hold past the timeout", {
+            {0, KEY_PRESS, SPACE}, {TIMEOUT_MILLISEC + 1, KEY_RELEASE, SPACE},
+        }, 0},
+        {"chord with a key", {
+            {0, KEY_PRESS, SPACE}, {50, KEY_PRESS, LETTER}, {90, KEY_RELEASE, LETTER},
+            {120, KEY_RELEASE, SPACE},
+        }, 0},
+        {"chord with a button", {
+            {0, KEY_PRESS, SPACE}, {50, BUTTON_PRESS, 1}, {90, BUTTON_RELEASE, 1},
+            {120, KEY_RELEASE, SPACE},
+        }, 0},
+        {"key before Space", {
+            {0, KEY_PRESS, LETTER}, {10, KEY_RELEASE, LETTER},
+            {20, KEY_PRESS, SPACE}, {90, KEY_RELEASE, SPACE},
+        }, 1},
+        {"modifier released during Space", {
+            {10, KEY_PRESS, CONTROL}, {30, KEY_PRESS, SPACE}, {60, KEY_RELEASE, CONTROL},
+            {90, KEY_RELEASE, SPACE},
+        }, 0},
+        {"modifier held across Space", {
+            {10, KEY_PRESS, CONTROL}, {30, KEY_PRESS, SPACE}, {60, KEY_RELEASE, SPACE},
+            {90, KEY_RELEASE, CONTROL},
+        }, 1},
+        {"modifier released during Space with rollover", {
+            {10, KEY_PRESS, CONTROL}, {30, KEY_PRESS, SPACE}, {60, KEY_RELEASE, CONTROL},
+            {90, KEY_RELEASE, SPACE},
+        }, 0, PERMISSIVE},
+        {"modifier released during Space preferring taps", {
+            {10, KEY_PRESS, CONTROL}, {30, KEY_PRESS, SPACE}, {60, KEY_RELEASE, CONTROL},
+            {90, KEY_RELEASE, SPACE},
+        }, 1, TAP_PREFERENCE},
+        {"previous letter released during Space", {
+            {10, KEY_PRESS, LETTER}, {30, KEY_PRESS, SPACE}, {60, KEY_RELEASE, LETTER},
+            {90, KEY_RELEASE, SPACE},
+        }, 1},
+        {"button released during Space", {
+            {10, BUTTON_PRESS, 1}, {30, KEY_PRESS, SPACE}, {60, BUTTON_RELEASE, 1},
+            {90, KEY_RELEASE, SPACE},
+        }, 0},
+        {"combo does not leak into the next tap", {
+            {0, KEY_PRESS, SPACE}, {50, KEY_PRESS, LETTER}, {60, KEY_RELEASE, LETTER},
+            {100, KEY_RELEASE, SPACE},
+            {200, KEY_PRESS, SPACE}, {260, KEY_RELEASE, SPACE},
+        }, 1},
+        {"autorepeat during a hold", {
+            {10, KEY_PRESS, SPACE}, {510, KEY_PRESS, SPACE}, {540, KEY_PRESS, SPACE}, {570, KEY_PRESS, SPACE},
+            {600, KEY_PRESS, SPACE}, {630, KEY_PRESS, SPACE}, {650, KEY_RELEASE, SPACE},
+        }, 0},
+        {"hold committed by the timer", {
+            {0, KEY_PRESS, SPACE}, {TIMEOUT_MILLISEC, HOLD_TIMER, 0}, {TIMEOUT_MILLISEC, KEY_RELEASE, SPACE},
+        }, 0},
+        {"hold committed by a late event", {
+            {0, KEY_PRESS, SPACE}, {TIMEOUT_MILLISEC + 1, KEY_PRESS, LETTER},
+            {TIMEOUT_MILLISEC + 2, KEY_RELEASE, LETTER}, {TIMEOUT_MILLISEC + 3, KEY_RELEASE, SPACE},
+        }, 0},
+        {"timer after the release", {
+            {0, KEY_PRESS, SPACE}, {80, KEY_RELEASE, SPACE}, {TIMEOUT_MILLISEC, HOLD_TIMER, 0},
+            {700, KEY_PRESS, SPACE}, {780, KEY_RELEASE, SPACE},
+        }, 2},
+        {"untimed tap", {
+            {0, KEY_PRESS, SPACE}, {80, KEY_RELEASE, SPACE},
+        }, 1, UNTIMED},
+        {"untimed hold", {
+            {0, KEY_PRESS, SPACE}, {TIMEOUT_MILLISEC + 1, KEY_RELEASE, SPACE},
+        }, 0, UNTIMED},
+        {"rollover as a combination", {
+            {0, KEY_PRESS, SPACE}, {30, KEY_PRESS, LETTER}, {50, KEY_RELEASE, SPACE},
+            {70, KEY_RELEASE, LETTER},
+        }, 0},
+        {"rollover as a tap", {
+            {0, KEY_PRESS, SPACE}, {30, KEY_PRESS, LETTER}, {50, KEY_RELEASE, SPACE},
+            {70, KEY_RELEASE, LETTER},
+        }, 1, PERMISSIVE},
+        {"chord despite rollover", {
+            {0, KEY_PRESS, SPACE}, {50, KEY_PRESS, LETTER}, {90, KEY_RELEASE, LETTER},
+            {120, KEY_RELEASE, SPACE},
+        }, 0, PERMISSIVE},
+        {"rollover key limit", {
+            {0, KEY_PRESS, SPACE}, {10, KEY_PRESS, LETTER}, {20, KEY_PRESS, LETTER + 1},
+            {30, KEY_PRESS, LETTER + 2}, {40, KEY_RELEASE, SPACE},
+            {50, KEY_RELEASE, LETTER}, {60, KEY_RELEASE, LETTER + 1}, {70, KEY_RELEASE, LETTER + 2},
+        }, 0, PERMISSIVE},
+        {"rollover until the timer", {
+            {0, KEY_PRESS, SPACE}, {30, KEY_PRESS, LETTER}, {TIMEOUT_MILLISEC, HOLD_TIMER, 0},
+            {TIMEOUT_MILLISEC + 10, KEY_RELEASE, SPACE}, {TIMEOUT_MILLISEC + 20, KEY_RELEASE, LETTER},
+        }, 0, PERMISSIVE},
+        {"rollover within the overlap", {
+            {0, KEY_PRESS, SPACE}, {30, KEY_PRESS, LETTER}, {30 + ROLLOVER_OVERLAP_MILLISEC, KEY_RELEASE, SPACE},
+            {200, KEY_RELEASE, LETTER},
+        }, 1, ROLLOVER_OVERLAP},
+        {"rollover past the overlap", {
+            {0, KEY_PRESS, SPACE}, {30, KEY_PRESS, LETTER}, {31 + ROLLOVER_OVERLAP_MILLISEC, KEY_RELEASE, SPACE},
+            {200, KEY_RELEASE, LETTER},
+        }, 0, ROLLOVER_OVERLAP},
+        {"chord preferring taps", {
+            {0, KEY_PRESS, SPACE}, {50, KEY_PRESS, LETTER}, {90, KEY_RELEASE, LETTER},
+            {120, KEY_RELEASE, SPACE},
+        }, 1, TAP_PREFERENCE},
+        {"long chord preferring taps", {
+            {0, KEY_PRESS, SPACE}, {50, KEY_PRESS, LETTER}, {90, KEY_RELEASE, LETTER},
+            {TIMEOUT_MILLISEC + 1, KEY_RELEASE, SPACE},
+        }, 0, TAP_PREFERENCE},
+        {"early hold commit", {
+            {0, KEY_PRESS, SPACE}, {HOLD_COMMIT_MILLISEC + 1, KEY_RELEASE, SPACE},
+        }, 0, EARLY_HOLD},
+        {"tap before the early hold commit", {
+            {0, KEY_PRESS, SPACE}, {HOLD_COMMIT_MILLISEC, KEY_RELEASE, SPACE},
+        }, 1, EARLY_HOLD},
+        {"space in a typing streak", {
+            {10, KEY_PRESS, LETTER}, {40, KEY_RELEASE, LETTER},
+            {10 + TYPING_STREAK_MILLISEC, KEY_PRESS, SPACE}, {10 + TYPING_STREAK_MILLISEC + 60, KEY_PRESS, LETTER},
+            {10 + TYPING_STREAK_MILLISEC + 80, KEY_RELEASE, SPACE}, {10 + TYPING_STREAK_MILLISEC + 100, KEY_RELEASE, LETTER},
+        }, 1, TYPING_STREAK},
+        {"long space in a typing streak", {
+            {10, KEY_PRESS, LETTER}, {40, KEY_RELEASE, LETTER},
+            {100, KEY_PRESS, SPACE}, {100 + TIMEOUT_MILLISEC + 1, KEY_RELEASE, SPACE},
+        }, 1, TYPING_STREAK},
+        {"chord from idle", {
+            {10, KEY_PRESS, LETTER}, {40, KEY_RELEASE, LETTER},
+            {10 + TYPING_STREAK_MILLISEC + 1, KEY_PRESS, SPACE}, {10 + TYPING_STREAK_MILLISEC + 60, KEY_PRESS, LETTER},
+            {10 + TYPING_STREAK_MILLISEC + 80, KEY_RELEASE, LETTER}, {10 + TYPING_STREAK_MILLISEC + 100, KEY_RELEASE, SPACE},
+        }, 0, TYPING_STREAK},
+        {"another dual-role key", {
+            {0, KEY_PRESS, CAPS_LOCK}, {80, KEY_RELEASE, CAPS_LOCK},
+            {100, KEY_PRESS, SPACE}, {180, KEY_RELEASE, SPACE},
+        }, 1, CAPS_LOCK_DUAL_ROLE, 1},
+        {"another dual-role key held", {
+            {0, KEY_PRESS, CAPS_LOCK}, {50, KEY_PRESS, LETTER}, {90, KEY_RELEASE, LETTER},
+            {120, KEY_RELEASE, CAPS_LOCK},
+        }, 0, CAPS_LOCK_DUAL_ROLE, 0},
+        {"a timeout per key", {
+            {0, KEY_PRESS, CAPS_LOCK}, {CAPS_LOCK_TIMEOUT_MILLISEC + 1, KEY_RELEASE, CAPS_LOCK},
+            {300, KEY_PRESS, SPACE}, {300 + CAPS_LOCK_TIMEOUT_MILLISEC + 1, KEY_RELEASE, SPACE},
+        }, 1, CAPS_LOCK_DUAL_ROLE, 0},
+        {"two dual-role keys together", {
+            {0, KEY_PRESS, CAPS_LOCK}, {50, KEY_PRESS, SPACE}, {90, KEY_RELEASE, SPACE},
+            {120, KEY_RELEASE, CAPS_LOCK},
+        }, 1, CAPS_LOCK_DUAL_ROLE, 0},
+        {"dual-role key released during another", {
+            {0, KEY_PRESS, CAPS_LOCK}, {50, KEY_PRESS, SPACE}, {90, KEY_RELEASE, CAPS_LOCK},
+            {120, KEY_RELEASE, SPACE},
+        }, 0, CAPS_LOCK_DUAL_ROLE, 0},
+        {"chord after a click", {
+            {0, KEY_PRESS, LETTER}, {20, KEY_RELEASE, LETTER}, {40, BUTTON_PRESS, 1}, {60, BUTTON_RELEASE, 1},
+            {80, KEY_PRESS, SPACE}, {100, KEY_PRESS, LETTER},
+            {120, KEY_RELEASE, LETTER}, {140, KEY_RELEASE, SPACE},
+        }, 0, TYPING_STREAK},
+    };
+    return all;
+}
+
+bool check_traces() {
+    bool success = true;
+    for (const Trace& trace : traces()) {
+        ReplayResult result = replay(trace);
+        if (result.spaces != trace.expected_spaces || result.other_taps != trace.expected_other_taps) {
+            std::cerr << "FAIL " << trace.name << ": typed " << result.spaces << " space(s) and " <<
+                result.other_taps << " other tap(s), expected " << trace.expected_spaces << " and " <<
+                trace.expected_other_taps << std::endl;
+            success = false;
+        } else {
+            std::cout << "ok   " << trace.name << std::endl;
+        }
+    }
+    return success;
+}
+
+bool check_server_time() {
+    ServerTime server_time;
+    const std::uint32_t before_wraparound = 0xffffff00;
+    Timestamp start = server_time.extend(before_wraparound);
+    Timestamp wrapped = server_time.extend(before_wraparound + 0x200);
+    Timestamp backwards = server_time.extend(before_wraparound + 0x1ff);
+    if (start == NO_TIME || wrapped - start != 0x200 * 1000 || wrapped - backwards != 1000) {
+        std::cerr << "FAIL server time wraparound" << std::endl;
+        return false;
+    }
+    std::cout << "ok   server time wraparound" << std::endl;
+    return true;
+}
+
+bool check_spsc_queue() {
+    const int ITEMS = 1000000;
+    SpscQueue<int, 64> queue;
+
+    std::thread producer([&queue]() {
+        for (int item = 0; item < ITEMS; ++item) {
+            while (! queue.push(item)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    bool in_order = true;
+    for (int expected = 0; expected < ITEMS; ++expected) {
+        int item;
+        while (! queue.pop(item)) {
+            std::this_thread::yield();
+        }
+        in_order = in_order && item == expected;
+    }
+    producer.join();
+
+    if (! in_order) {
+        std::cerr << "FAIL single-producer single-consumer queue order" << std::endl;
+        return false;
+    }
+    std::cout << "ok   single-producer single-consumer queue order" << std::endl;
+    return true;
+}
+
+// Writes enough records into a small trace file to wrap around its ring a few times,
+// checking that the newest ones read back intact and timing the writes.
+bool check_trace_file() {
+    const std::string path = "/tmp/engine_check." + std::to_string(getpid()) + ".trace";
+    const int RECORDS = 100000;
+
+    std::vector<TraceRecord> written;
+    double seconds;
+    {
+        TraceWriter writer;
+        if (! writer.open(path, /* capacity */ 16384)) {
+            return false;
+        }
+        std::minstd_rand random(42);
+        Timestamp time = 1000000;
+        // Of the last timed event, which the decisions carry.
+        Timestamp last_time = NO_TIME;
+        auto start = std::chrono::steady_clock::now();
+        for (int index = 0; index < RECORDS; ++index) {
+            KeyCode key_code = static_cast<KeyCode>(random());
+            if (index % 5 == 4) {
+                writer.record_decision(TRACE_TAP, key_code);
+                written.push_back({TRACE_TAP, key_code, last_time});
+                continue;
+            }
+            // Mostly typing, some long pauses and clock steps back, an untimed event now and then.
+            time += std::uniform_int_distribution<Timestamp>(0, index % 97 == 0 ? 100000000 : 200000)(random);
+            time -= index % 1009 == 0 ? 5000 : 0;
+            Timestamp event_time = index % 89 == 1 ? NO_TIME : time;
+            int event_type = index % 2 ? KEY_RELEASE : KEY_PRESS;
+            writer.record_event(event_type, key_code, event_time);
+            written.push_back({event_type, key_code, event_time});
+            last_time = event_time != NO_TIME ? event_time : last_time;
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::vector<TraceRecord> records;
+    bool read = read_trace(path, records);
+    unlink(path.c_str());
+
+    bool intact = read && ! records.empty() && records.size() < written.size();
+    for (std::size_t index = 0; intact && index < records.size(); ++index) {
+        const TraceRecord& record = records[index];
+        const TraceRecord& expected = written[written.size() - records.size() + index];
+        intact = record.kind == expected.kind && record.key_code == expected.key_code && record.time == expected.time;
+    }
+    if (! intact) {
+        std::cerr << "FAIL trace file ring round trip" << std::endl;
+        return false;
+    }
+    std::cout << "ok   trace file ring round trip (" << records.size() << " records kept, " <<
+        seconds / RECORDS * 1e9 << " ns per record)" << std::endl;
+    return true;
+}
+
+// Replays a recorded tap, a chord and a hold committed by the timer (at the end of the trace).
+bool check_trace_replay() {
+    const Timestamp START = 5000000;
+    const std::vector<TraceRecord> records = {
+        {KEY_PRESS, SPACE, START}, {KEY_RELEASE, SPACE, START + 80000}, {TRACE_TAP, SPACE, START + 80000},
+        {KEY_PRESS, SPACE, START + 200000}, {KEY_PRESS, LETTER, START + 250000}, {TRACE_HOLD, SPACE, START + 250000},
+        {KEY_RELEASE, LETTER, START + 290000}, {KEY_RELEASE, SPACE, NO_TIME},
+        {TRACE_RELEASE_HOLD, SPACE, START + 290000},
+        {KEY_PRESS, SPACE, START + 400000},
+    };
+    const std::vector<TraceRecord> expected = {
+        {TRACE_TAP, SPACE, START + 80000}, {TRACE_HOLD, SPACE, START + 250000},
+        {TRACE_RELEASE_HOLD, SPACE, START + 290000},
+        {TRACE_HOLD, SPACE, START + 400000 + TIMEOUT_MILLISEC * 1000},
+    };
+
+    TraceReplay replay(SPACE, TIMEOUT_MILLISEC);
+    for (const TraceRecord& record : records) {
+        replay.feed(record);
+    }
+    replay.commit_hold();
+
+    const std::vector<TraceRecord>& decisions = replay.decisions();
+    bool same = decisions.size() == expected.size();
+    for (std::size_t index = 0; same && index < expected.size(); ++index) {
+        same = decisions[index].kind == expected[index].kind && decisions[index].key_code == expected[index].key_code &&
+            decisions[index].time == expected[index].time;
+    }
+    if (! same) {
+        std::cerr << "FAIL trace replay decisions" << std::endl;
+        return false;
+    }
+    std::cout << "ok   trace replay decisions" << std::endl;
+    return true;
+}
+
+void sort_by_time(std::vector<Trace>& traces) {
+    for (Trace& trace : traces) {
+        std::stable_sort(trace.events.begin(), trace.events.end(),
+            [](const TraceEvent& left, const TraceEvent& right) { return left.millisec < right.millisec; });
+    }
+}
+
+// Replays generated fast typing (with spaces rolling over into the next word), Super chords
+// and sloppy ones (Space released before the other key) under each tap-hold strategy, reporting
+// how many of them it gets wrong and how long after the press of Space it decides upon it.
+void measure_strategies() {
+    const int SAMPLES = 100000;
+    std::minstd_rand random(42);
+    auto between = [&random](int from, int to) {
+        return std::uniform_int_distribution<int>(from, to)(random);
+    };
+
+    std::vector<Trace> typing, chords, sloppy_chords;
+    for (int sample = 0; sample < SAMPLES; ++sample) {
+        // A fast typist: the next letter follows Space quickly, often before it is released.
+        int letter_down = between(30, 130);
+        typing.push_back({"typing", {
+            {0, KEY_PRESS, SPACE}, {letter_down, KEY_PRESS, LETTER},
+            {between(50, 120), KEY_RELEASE, SPACE}, {letter_down + between(50, 120), KEY_RELEASE, LETTER},
+        }, 1});
+        // A deliberate chord: the key comes later and is released first.
+        int key_down = between(150, 350);
+        chords.push_back({"chord", {
+            {0, KEY_PRESS, SPACE}, {key_down, KEY_PRESS, LETTER},
+            {key_down + between(60, 120), KEY_RELEASE, LETTER},
+            {key_down + between(130, 250), KEY_RELEASE, SPACE},
+        }, 0});
+        // Or it stays down together with Space for longer, but is released last.
+        key_down = between(150, 350);
+        sloppy_chords.push_back({"sloppy chord", {
+            {0, KEY_PRESS, SPACE}, {key_down, KEY_PRESS, LETTER},
+            {key_down + between(120, 250), KEY_RELEASE, SPACE},
+            {key_down + between(260, 300), KEY_RELEASE, LETTER},
+        }, 0});
+    }
+    sort_by_time(typing);
+    sort_by_time(chords);
+    sort_by_time(sloppy_chords);
+
+    struct Outcome {
+        double misfire_percentage;
+        double mean_decision_millisec;
+    };
+    auto replay_all = [](std::vector<Trace>& traces, int options) {
+        int misfires = 0;
+        double total_decision_millisec = 0;
+        for (Trace& trace : traces) {
+            trace.options = options;
+            ReplayResult result = replay(trace);
+            misfires += result.spaces != trace.expected_spaces;
+            total_decision_millisec += result.decision_millisec;
+        }
+        return Outcome{100.0 * misfires / traces.size(), total_decision_millisec / traces.size()};
+    };
+    const std::pair<const char*, int> strategies[] = {
+        {"hold-on-other-key-press", 0},
+        {"hold-on-other-key-press, early hold", EARLY_HOLD},
+        {"permissive-hold", PERMISSIVE},
+        {"permissive-hold, overlap limit", ROLLOVER_OVERLAP},
+        {"tap-preferred", TAP_PREFERENCE},
+    };
+    for (const auto& strategy : strategies) {
+        Outcome typing_outcome = replay_all(typing, strategy.second);
+        Outcome chord_outcome = replay_all(chords, strategy.second);
+        Outcome sloppy_outcome = replay_all(sloppy_chords, strategy.second);
+        std::cout << strategy.first << ": " <<
+            "typing " << typing_outcome.misfire_percentage << "% wrong, decided in " <<
+            typing_outcome.mean_decision_millisec << " ms; " <<
+            "chords " << chord_outcome.misfire_percentage << "% wrong, " <<
+            chord_outcome.mean_decision_millisec << " ms; " <<
+            "sloppy chords " << sloppy_outcome.misfire_percentage << "% wrong, " <<
+            sloppy_outcome.mean_decision_millisec << " ms" << std::endl;
+    }
+}
+
+// Replays generated words followed by a space, reporting how long after its press the space is typed.
+void measure_typing_streak_latency() {
+    const int SAMPLES = 100000;
+    std::minstd_rand random(42);
+    auto between = [&random](int from, int to) {
+        return std::uniform_int_distribution<int>(from, to)(random);
+    };
+
+    const int SPACE_DOWN = 200;
+    std::vector<Trace> words;
+    for (int sample = 0; sample < SAMPLES; ++sample) {
+        int letter_down = SPACE_DOWN - between(60, 140);
+        words.push_back({"word", {
+            {letter_down, KEY_PRESS, LETTER}, {letter_down + between(40, 100), KEY_RELEASE, LETTER},
+            {SPACE_DOWN, KEY_PRESS, SPACE}, {SPACE_DOWN + between(50, 150), KEY_RELEASE, SPACE},
+        }, 1});
+        std::stable_sort(words.back().events.begin(), words.back().events.end(),
+            [](const TraceEvent& left, const TraceEvent& right) { return left.millisec < right.millisec; });
+    }
+
+    const std::pair<const char*, int> modes[] = {{"on release", 0}, {"in typing streaks", TYPING_STREAK}};
+    for (const auto& mode : modes) {
+        double total_millisec = 0;
+        for (Trace& word : words) {
+            word.options = mode.second;
+            total_millisec += replay(word).last_space_millisec - SPACE_DOWN;
+        }
+        std::cout << "Spaces typed " << mode.first << ": " <<
+            total_millisec / words.size() << " ms after the press on average" << std::endl;
+    }
+}
+
+// Words of five letters separated by tapped spaces.
+void measure_throughput() {
+    const int WORDS = 1000000;
+
+    std::vector<TraceEvent> events;
+    events.reserve(WORDS * 12);
+    int millisec = 0;
+    for (int word = 0; word < WORDS; ++word) {
+        for (int letter = 0; letter < 5; ++letter) {
+            events.push_back({millisec += 40, KEY_PRESS, static_cast<KeyCode>(LETTER + letter)});
+            events.push_back({millisec += 40, KEY_RELEASE, static_cast<KeyCode>(LETTER + letter)});
+        }
+        events.push_back({millisec += 40, KEY_PRESS, SPACE});
+        events.push_back({millisec += 80, KEY_RELEASE, SPACE});
+    }
+
+    TraceClock clock;
+    CountingOutput output(clock);
+    Engine engine(SPACE, TIMEOUT_MILLISEC, clock, output);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const TraceEvent& event : events) {
+        engine.process_event(event.type, event.key_code, static_cast<Timestamp>(event.millisec) * 1000);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "Replayed " << events.size() << " events (" << output.spaces() << " spaces) in " <<
+        seconds * 1000 << " ms: " << events.size() / seconds / 1e6 << " M events/s" << std::endl;
+}
+
+}  // namespace
+
+
+int main() {
+    if (! check_traces() || ! check_server_time() || ! check_spsc_queue() || ! check_trace_file() ||
+        ! check_trace_replay())
+    {
+        return EXIT_FAILURE;
+    }
+    measure_strategies();
+    measure_typing_streak_latency();
+    measure_throughput();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#include "evdev.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+
+
+namespace {
+
+// How long `EvdevDevice::grab` waits for the keys to be released.
+const int GRAB_WAIT_MILLISEC = 2000;
+const int GRAB_POLL_MILLISEC = 10;
+
+bool any_key_down(int fd) {
+    unsigned char key_states[KEY_MAX / 8 + 1];
+    std::memset(key_states, 0, sizeof(key_states));
+    if (ioctl(fd, EVIOCGKEY(sizeof(key_states)), key_states) < 0) {
+        return false;
+    }
+    for (unsigned char states : key_states) {
+        if (states != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+
+int evdev_code(KeySymbol key_symbol) {
+    switch (key_symbol) {
+    case KEY_SYMBOL_SPACE: return KEY_SPACE;
+    case KEY_SYMBOL_BACKSPACE: return KEY_BACKSPACE;
+    case KEY_SYMBOL_TAB: return KEY_TAB;
+    case KEY_SYMBOL_RETURN: return KEY_ENTER;
+    case KEY_SYMBOL_ESCAPE: return KEY_ESC;
+    case KEY_SYMBOL_MENU: return KEY_COMPOSE;
+    case KEY_SYMBOL_DELETE: return KEY_DELETE;
+    case KEY_SYMBOL_SHIFT_L: return KEY_LEFTSHIFT;
+    case KEY_SYMBOL_SHIFT_R: return KEY_RIGHTSHIFT;
+    case KEY_SYMBOL_CONTROL_L: return KEY_LEFTCTRL;
+    case KEY_SYMBOL_CONTROL_R: return KEY_RIGHTCTRL;
+    case KEY_SYMBOL_CAPS_LOCK: return KEY_CAPSLOCK;
+    case KEY_SYMBOL_ALT_L: return KEY_LEFTALT;
+    case KEY_SYMBOL_ALT_R: return KEY_RIGHTALT;
+    case KEY_SYMBOL_SUPER_L: return KEY_LEFTMETA;
+    case KEY_SYMBOL_SUPER_R: return KEY_RIGHTMETA;
+    case KEY_SYMBOL_ISO_LEVEL3_SHIFT: return KEY_RIGHTALT;
+    default: return 0;
+    }
+}
+
+
+EvdevDevice::~EvdevDevice() {
+    if (grabbed_) {
+        ioctl(fd_.get(), EVIOCGRAB, 0);
+    }
+}
+
+bool EvdevDevice::open(const std::string& path) {
+    fd_.reset(::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+    if (! fd_.valid()) {
+        std::cerr << "Could not open the input device '" << path << "': " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Event times comparable with the engine clock and immune to wall clock changes.
+    int clock_id = CLOCK_MONOTONIC;
+    if (ioctl(fd_.get(), EVIOCSCLOCKID, &clock_id) < 0) {
+        std::cerr << "Could not make the input device timestamps monotonic: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool EvdevDevice::grab() {
+    for (int waited = 0; waited < GRAB_WAIT_MILLISEC && any_key_down(fd_.get()); waited += GRAB_POLL_MILLISEC) {
+        usleep(GRAB_POLL_MILLISEC * 1000);
+    }
+
+    if (ioctl(fd_.get(), EVIOCGRAB, 1) < 0) {
+        std::cerr << "Could not grab the input device: " << strerror(errno) << std::endl;
+        return false;
+    }
+    grabbed_ = true;
+
+    // Drop whatever has been read before the grab.
+    input_event events[64];
+    while (read_events(events, 64) > 0) {
+    }
+    return true;
+}
+
+int EvdevDevice::read_events(input_event* events, int capacity) {
+    ssize_t size = read(fd_.get(), events, sizeof(input_event) * capacity);
+    if (size < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            std::cerr << "Could not read from the input device: " << strerror(errno) << std::endl;
+        }
+        return 0;
+    }
+    return static_cast<int>(size / sizeof(input_event));
+}
+
+
+UinputKeyboard::~UinputKeyboard() {
+    if (created_) {
+        ioctl(fd_.get(), UI_DEV_DESTROY);
+    }
+}
+
+bool UinputKeyboard::create(const char* name) {
+    fd_.reset(::open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC));
+    if (! fd_.valid()) {
+        std::cerr << "Could not open /dev/uinput: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Autorepeat (`EV_REP`) is not enabled: the repeats of the original device are passed through.
+    bool configured =
+        ioctl(fd_.get(), UI_SET_EVBIT, EV_SYN) >= 0 &&
+        ioctl(fd_.get(), UI_SET_EVBIT, EV_KEY) >= 0 &&
+        ioctl(fd_.get(), UI_SET_EVBIT, EV_MSC) >= 0 &&
+        ioctl(fd_.get(), UI_SET_MSCBIT, MSC_SCAN) >= 0;
+    // Keyboard keys only (no buttons), so that the device is classified as a keyboard.
+    for (int code = KEY_ESC; configured && code < BTN_MISC; ++code) {
+        configured = ioctl(fd_.get(), UI_SET_KEYBIT, code) >= 0;
+    }
+
+    uinput_setup setup;
+    std::memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    std::strncpy(setup.name, name, UINPUT_MAX_NAME_SIZE - 1);
+
+    if (! configured ||
+        ioctl(fd_.get(), UI_DEV_SETUP, &setup) < 0 ||
+        ioctl(fd_.get(), UI_DEV_CREATE) < 0)
+    {
+        std::cerr << "Could not create a virtual keyboard: " << strerror(errno) << std::endl;
+        return false;
+    }
+    created_ = true;
+    return true;
+}
+
+std::string UinputKeyboard::device_node() const {
+    char system_name[64];
+    if (ioctl(fd_.get(), UI_GET_SYSNAME(sizeof(system_name)), system_name) < 0) {
+        return std::string();
+    }
+
+    std::string system_path = std::string("/sys/devices/virtual/input/") + system_name;
+    DIR* directory = opendir(system_path.c_str());
+    if (directory == nullptr) {
+        return std::string();
+    }
+    std::string node;
+    while (dirent* entry = readdir(directory)) {
+        if (std::strncmp(entry->d_name, "event", 5) == 0) {
+            node = std::string("/dev/input/") + entry->d_name;
+            break;
+        }
+    }
+    closedir(directory);
+    return node;
+}
+
+void UinputKeyboard::queue(const input_event& event) {
+    queued_.push_back(event);
+}
+
+void UinputKeyboard::queue_key(int code, int value) {
+    // The kernel stamps the time of the events written to uinput.
+    input_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.type = EV_KEY;
+    event.code = static_cast<__u16>(code);
+    event.value = value;
+    queued_.push_back(event);
+
+    event.type = EV_SYN;
+    event.code = SYN_REPORT;
+    event.value = 0;
+    queued_.push_back(event);
+}
+
+bool UinputKeyboard::flush() {
+    if (queued_.empty()) {
+        return true;
+    }
+    ssize_t size = static_cast<ssize_t>(sizeof(input_event) * queued_.size());
+    bool written = write(fd_.get(), queued_.data(), size) == size;
+    if (! written) {
+        std::cerr << "Could not write to the virtual keyboard: " << strerror(errno) << std::endl;
+    }
+    queued_.clear();
+    return written;
+}
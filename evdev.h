@@ -0,0 +1,82 @@
+#ifndef SPACE2SUPER_EVDEV_H
+#define SPACE2SUPER_EVDEV_H
+
+/*
+    Linux input devices: reading (and exclusively grabbing) an evdev keyboard
+    and re-emitting events through a `uinput` virtual keyboard.
+*/
+
+#include <string>
+#include <vector>
+
+#include <linux/input.h>
+
+#include "engine.h"
+#include "event_loop.h"
+#include "keysyms.h"
+
+
+// X key codes are evdev codes shifted by this much (see the X evdev driver).
+const int EVDEV_TO_X_KEY_CODE_OFFSET = 8;
+
+// The key which types or acts as `key_symbol` (on a US layout); 0 for those outside `keysyms.h`.
+int evdev_code(KeySymbol key_symbol);
+
+// `input_event` times (made monotonic by `EvdevDevice::open`) as engine timestamps.
+inline Timestamp evdev_timestamp(const input_event& event) {
+    return static_cast<Timestamp>(event.time.tv_sec) * 1000000 + event.time.tv_usec;
+}
+
+
+class EvdevDevice {
+public:
+    EvdevDevice() {}
+    EvdevDevice(const EvdevDevice&) = delete;
+    EvdevDevice& operator=(const EvdevDevice&) = delete;
+    ~EvdevDevice();
+
+    bool open(const std::string& path);
+
+    // Takes the device away from everyone else (including X) once no key is held down,
+    // so that e.g. the Enter which has started the program does not get stuck.
+    bool grab();
+
+    int fd() const {
+        return fd_.get();
+    }
+
+    // Reads the available events without blocking; returns their number.
+    int read_events(input_event* events, int capacity);
+
+private:
+    FileDescriptor fd_;
+    bool grabbed_ = false;
+};
+
+
+// A virtual keyboard; events are queued and written at once by `flush`.
+class UinputKeyboard {
+public:
+    UinputKeyboard() {}
+    UinputKeyboard(const UinputKeyboard&) = delete;
+    UinputKeyboard& operator=(const UinputKeyboard&) = delete;
+    ~UinputKeyboard();
+
+    bool create(const char* name);
+
+    // The /dev/input/event* node of the created device (empty if unknown).
+    std::string device_node() const;
+
+    void queue(const input_event& event);
+    // Queues a key event followed by a synchronization report.
+    void queue_key(int code, int value);
+    bool flush();
+
+private:
+    FileDescriptor fd_;
+    bool created_ = false;
+    std::vector<input_event> queued_;
+};
+
+
+#endif  // SPACE2SUPER_EVDEV_H
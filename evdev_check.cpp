@@ -0,0 +1,216 @@
+/*
+    Checks the evdev backend end to end without real hardware: creates a fake uinput keyboard,
+    runs `EvdevDaemon` on it in a child process and compares what comes out of the daemon's
+    virtual keyboard with the expectations. Needs write access to /dev/uinput (e.g. root).
+
+    Build and run with:
+        make evdev-check
+*/
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "evdev.h"
+#include "evdev_daemon.h"
+
+
+namespace {
+
+const int TIMEOUT_MILLISEC = 200;
+const char* DAEMON_KEYBOARD_NAME = "Space2Super virtual keyboard";
+// Nothing more is expected to come out after that much silence.
+const int QUIET_MILLISEC = 100;
+
+typedef std::pair<int, int> KeyEvent;  // The code and the value.
+
+struct Step {
+    int code;
+    int value;
+    // Before the next step.
+    int pause_millisec;
+};
+
+struct Case {
+    const char* name;
+    std::vector<Step> steps;
+    std::vector<KeyEvent> expected;
+};
+
+std::string find_device_node(const std::string& name) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        DIR* directory = opendir("/sys/class/input");
+        if (directory == nullptr) {
+            return std::string();
+        }
+        std::string node;
+        while (dirent* entry = readdir(directory)) {
+            if (std::strncmp(entry->d_name, "event", 5) != 0) {
+                continue;
+            }
+            std::ifstream name_file(std::string("/sys/class/input/") + entry->d_name + "/device/name");
+            std::string device_name;
+            if (std::getline(name_file, device_name) && device_name == name) {
+                node = std::string("/dev/input/") + entry->d_name;
+                break;
+            }
+        }
+        closedir(directory);
+        if (! node.empty()) {
+            return node;
+        }
+        usleep(20000);
+    }
+    return std::string();
+}
+
+std::vector<KeyEvent> read_key_events(int fd) {
+    std::vector<KeyEvent> key_events;
+    pollfd source = {fd, POLLIN, 0};
+    while (poll(&source, /* nfds */ 1, QUIET_MILLISEC) > 0) {
+        input_event event;
+        while (read(fd, &event, sizeof(event)) == sizeof(event)) {
+            if (event.type == EV_KEY) {
+                key_events.push_back(KeyEvent(event.code, event.value));
+            }
+        }
+    }
+    return key_events;
+}
+
+bool run_case(const Case& check_case, UinputKeyboard& source, int output_fd) {
+    for (const Step& step : check_case.steps) {
+        source.queue_key(step.code, step.value);
+        source.flush();
+        if (step.pause_millisec > 0) {
+            usleep(step.pause_millisec * 1000);
+        }
+    }
+
+    std::vector<KeyEvent> key_events = read_key_events(output_fd);
+    if (key_events != check_case.expected) {
+        std::cerr << "FAIL " << check_case.name << ":";
+        for (const KeyEvent& key_event : key_events) {
+            std::cerr << ' ' << key_event.first << '=' << key_event.second;
+        }
+        std::cerr << std::endl;
+        return false;
+    }
+    std::cout << "ok   " << check_case.name << std::endl;
+    return true;
+}
+
+}  // namespace
+
+
+int main() {
+    if (access("/dev/uinput", W_OK) != 0) {
+        std::cout << "skipped: /dev/uinput is not writable" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    UinputKeyboard source;
+    if (! source.create("Space2Super fake keyboard")) {
+        return EXIT_FAILURE;
+    }
+    std::string source_node = find_device_node("Space2Super fake keyboard");
+    if (source_node.empty()) {
+        std::cerr << "Could not find the fake keyboard device node." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    pid_t daemon_pid = fork();
+    if (daemon_pid == 0) {
+        try {
+            EngineOptions options;
+            options.strategy = PERMISSIVE_HOLD;
+            DualRoleKey caps_lock;
+            caps_lock.key_code = KEY_CAPSLOCK + EVDEV_TO_X_KEY_CODE_OFFSET;
+            caps_lock.tap = KEY_SYMBOL_ESCAPE;
+            caps_lock.hold = KEY_SYMBOL_CONTROL_L;
+            options.keys.push_back(caps_lock);
+            EvdevDaemon daemon(source_node, KEY_SPACE + EVDEV_TO_X_KEY_CODE_OFFSET, TIMEOUT_MILLISEC, options);
+            daemon.run();
+        } catch (const EvdevDaemon::InitializationError&) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    std::string output_node = find_device_node(DAEMON_KEYBOARD_NAME);
+    int output_fd = output_node.empty() ? -1 : open(output_node.c_str(), O_RDONLY | O_NONBLOCK);
+    if (output_fd < 0) {
+        std::cerr << "Could not open the daemon's virtual keyboard." << std::endl;
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, nullptr, 0);
+        return EXIT_FAILURE;
+    }
+    // Let the daemon grab the fake keyboard.
+    usleep(200000);
+
+    const std::vector<Case> cases = {
+        {"tap", {
+            {KEY_SPACE, 1, 50}, {KEY_SPACE, 0, 0},
+        }, {
+            {KEY_SPACE, 1}, {KEY_SPACE, 0},
+        }},
+        {"autorepeat", {
+            {KEY_SPACE, 1, 20}, {KEY_SPACE, 2, 30}, {KEY_SPACE, 2, 30}, {KEY_SPACE, 0, 0},
+        }, {
+            {KEY_SPACE, 1}, {KEY_SPACE, 0},
+        }},
+        {"other keys pass through", {
+            {KEY_A, 1, 0}, {KEY_A, 0, 0},
+        }, {
+            {KEY_A, 1}, {KEY_A, 0},
+        }},
+        {"chord", {
+            {KEY_SPACE, 1, 20}, {KEY_A, 1, 0}, {KEY_A, 0, 20}, {KEY_SPACE, 0, 0},
+        }, {
+            {KEY_LEFTMETA, 1}, {KEY_A, 1}, {KEY_A, 0}, {KEY_LEFTMETA, 0},
+        }},
+        {"rollover", {
+            {KEY_SPACE, 1, 20}, {KEY_A, 1, 20}, {KEY_SPACE, 0, 20}, {KEY_A, 0, 0},
+        }, {
+            {KEY_SPACE, 1}, {KEY_SPACE, 0}, {KEY_A, 1}, {KEY_A, 0},
+        }},
+        {"hold past the timeout", {
+            {KEY_SPACE, 1, TIMEOUT_MILLISEC + 100}, {KEY_SPACE, 0, 0},
+        }, {
+            {KEY_LEFTMETA, 1}, {KEY_LEFTMETA, 0},
+        }},
+        {"another dual-role key", {
+            {KEY_CAPSLOCK, 1, 20}, {KEY_CAPSLOCK, 0, 0}, {KEY_CAPSLOCK, 1, 20}, {KEY_C, 1, 0}, {KEY_C, 0, 20},
+            {KEY_CAPSLOCK, 0, 0},
+        }, {
+            {KEY_ESC, 1}, {KEY_ESC, 0}, {KEY_LEFTCTRL, 1}, {KEY_C, 1}, {KEY_C, 0}, {KEY_LEFTCTRL, 0},
+        }},
+    };
+
+    bool success = true;
+    for (const Case& check_case : cases) {
+        success = run_case(check_case, source, output_fd) && success;
+    }
+
+    close(output_fd);
+    kill(daemon_pid, SIGTERM);
+    int status = 0;
+    waitpid(daemon_pid, &status, 0);
+    if (! WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        std::cerr << "FAIL the daemon did not exit cleanly" << std::endl;
+        success = false;
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,217 @@
+#include "evdev_daemon.h"
+
+#include <iostream>
+
+#include <signal.h>
+#include <time.h>
+
+#include "log.h"
+
+
+namespace {
+
+// Events read from the device at once.
+const int READ_BATCH = 64;
+
+// Told to the engine to recognize chords with them already down.
+const int MODIFIER_CODES[] = {
+    KEY_LEFTSHIFT, KEY_RIGHTSHIFT, KEY_LEFTCTRL, KEY_RIGHTCTRL, KEY_LEFTALT, KEY_RIGHTALT, KEY_LEFTMETA, KEY_RIGHTMETA,
+};
+
+}  // namespace
+
+
+EvdevDaemon::EvdevDaemon(
+    const std::string& device_path, KeyCode space_key_code, int timeout_millisec, const EngineOptions& options,
+    const std::string& trace_path
+):
+    engine_(space_key_code, timeout_millisec, *this, *this, options)
+{
+    held_back_events_.reserve(64);
+
+    if ((! trace_path.empty() && ! trace_.open(trace_path)) || ! initialize(device_path)) {
+        throw InitializationError();
+    }
+}
+
+bool EvdevDaemon::initialize(const std::string& device_path) {
+    LOG("Initializing Space2Super on " << device_path << "...");
+
+    for (const DualRoleKey& key : engine_.dual_role_keys()) {
+        if (evdev_code(key.tap) == 0 || evdev_code(key.hold) == 0) {
+            std::cerr << "Key code " << static_cast<int>(key.key_code) << " has no evdev key to emit." << std::endl;
+            return false;
+        }
+    }
+    for (int code : MODIFIER_CODES) {
+        engine_.set_modifier_key(static_cast<KeyCode>(code + EVDEV_TO_X_KEY_CODE_OFFSET), true);
+    }
+
+    if (! device_.open(device_path) ||
+        ! keyboard_.create("Space2Super virtual keyboard") ||
+        ! device_.grab())
+    {
+        return false;
+    }
+
+    if (! loop_.open() ||
+        ! signals_.open({SIGINT, SIGTERM}) ||
+        ! hold_timer_.open() ||
+        ! loop_.watch(device_.fd(), [this]() { process_device_events(); }) ||
+        ! loop_.watch(signals_.fd(), [this]() { handle_signals(); }) ||
+        ! loop_.watch(hold_timer_.fd(), [this]() { handle_hold_timeout(); }))
+    {
+        return false;
+    }
+
+    LOG("Space2Super initialized successfully.");
+    return true;
+}
+
+void EvdevDaemon::run() {
+    if (! loop_.run()) {
+        throw InitializationError();
+    }
+    LOG("Space2Super event loop complete.");
+    report_holdback_statistics();
+    if (engine_.suppressed_repeats() > 0) {
+        std::clog << "Ignored " << engine_.suppressed_repeats() << " autorepeated key presses." << std::endl;
+    }
+}
+
+void EvdevDaemon::report_holdback_statistics() const {
+    if (holdback_statistics_.count == 0) {
+        return;
+    }
+    std::clog << "Held keys back " << holdback_statistics_.count << " times for " <<
+        holdback_statistics_.total_microsec / holdback_statistics_.count << " us on average, " <<
+        holdback_statistics_.max_microsec << " us at most." << std::endl;
+}
+
+void EvdevDaemon::process_device_events() {
+    input_event events[READ_BATCH];
+    int count;
+    while ((count = device_.read_events(events, READ_BATCH)) > 0) {
+        for (int index = 0; index < count; ++index) {
+            if (events[index].type == EV_KEY) {
+                process_key(events[index]);
+            } else {
+                pass(events[index]);
+            }
+        }
+    }
+    keyboard_.flush();
+}
+
+void EvdevDaemon::process_key(const input_event& event) {
+    // Codes beyond the X key code range are buttons and the like.
+    int x_key_code = event.code + EVDEV_TO_X_KEY_CODE_OFFSET;
+    if (x_key_code > 0xff) {
+        pass(event);
+        return;
+    }
+
+    // May emit a hold key first if this decides that a dual-role key is held.
+    // Autorepeat (a value of 2) comes as another press, which the engine ignores.
+    int event_type = event.value ? KEY_PRESS : KEY_RELEASE;
+    Timestamp time = evdev_timestamp(event);
+    trace_.record_event(event_type, static_cast<KeyCode>(x_key_code), time);
+    engine_.process_event(event_type, static_cast<KeyCode>(x_key_code), time);
+
+    // Dual-role keys themselves only come out as decided by the engine.
+    if (engine_.dual_role_key(static_cast<KeyCode>(x_key_code)) == nullptr) {
+        pass(event);
+    }
+}
+
+void EvdevDaemon::pass(const input_event& event) {
+    // Once anything is held back, everything after it is too, to keep the order.
+    if (engine_.holding_back() || ! held_back_events_.empty()) {
+        if (held_back_events_.empty()) {
+            holdback_start_ = now();
+        }
+        held_back_events_.push_back(event);
+    } else {
+        keyboard_.queue(event);
+    }
+}
+
+// Called once a dual-role key is decided upon (after emitting whatever it has turned into).
+void EvdevDaemon::release_held_back_events() {
+    if (held_back_events_.empty()) {
+        return;
+    }
+
+    for (const input_event& event : held_back_events_) {
+        keyboard_.queue(event);
+    }
+    held_back_events_.clear();
+
+    Timestamp held_back_microsec = now() - holdback_start_;
+    LOG("  Released the keys held back for " << held_back_microsec << " us");
+    ++holdback_statistics_.count;
+    holdback_statistics_.total_microsec += held_back_microsec;
+    if (held_back_microsec > holdback_statistics_.max_microsec) {
+        holdback_statistics_.max_microsec = held_back_microsec;
+    }
+}
+
+void EvdevDaemon::handle_hold_timeout() {
+    if (! hold_timer_.acknowledge()) {
+        return;
+    }
+
+    // A release that is already waiting on the device must win over the timer.
+    unsigned generation = hold_timer_generation_;
+    process_device_events();
+    if (generation == hold_timer_generation_) {
+        engine_.commit_hold();
+        keyboard_.flush();
+    }
+}
+
+void EvdevDaemon::handle_signals() {
+    while (int signal_number = signals_.read_signal()) {
+        LOG("Received signal " << signal_number << ".");
+        (void)signal_number;  // Prevent flagging as unused on NDEBUG.
+        loop_.stop();
+    }
+}
+
+// Only consulted for events that come without a timestamp.
+Timestamp EvdevDaemon::now() {
+    timespec moment;
+    clock_gettime(CLOCK_MONOTONIC, &moment);
+    return static_cast<Timestamp>(moment.tv_sec) * 1000000 + moment.tv_nsec / 1000;
+}
+
+void EvdevDaemon::tap(const DualRoleKey& key) {
+    trace_.record_decision(TRACE_TAP, key.key_code);
+    LOG("  Tapping " << evdev_code(key.tap));
+    keyboard_.queue_key(evdev_code(key.tap), 1);
+    keyboard_.queue_key(evdev_code(key.tap), 0);
+    release_held_back_events();
+}
+
+void EvdevDaemon::hold(const DualRoleKey& key) {
+    trace_.record_decision(TRACE_HOLD, key.key_code);
+    LOG("  Pressing " << evdev_code(key.hold));
+    keyboard_.queue_key(evdev_code(key.hold), 1);
+    release_held_back_events();
+}
+
+void EvdevDaemon::release_hold(const DualRoleKey& key) {
+    trace_.record_decision(TRACE_RELEASE_HOLD, key.key_code);
+    LOG("  Releasing " << evdev_code(key.hold));
+    keyboard_.queue_key(evdev_code(key.hold), 0);
+}
+
+void EvdevDaemon::schedule_hold(Timestamp microseconds) {
+    ++hold_timer_generation_;
+    hold_timer_.arm(microseconds);
+}
+
+void EvdevDaemon::cancel_hold() {
+    ++hold_timer_generation_;
+    hold_timer_.disarm();
+}
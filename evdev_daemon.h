@@ -0,0 +1,82 @@
+#ifndef SPACE2SUPER_EVDEV_DAEMON_H
+#define SPACE2SUPER_EVDEV_DAEMON_H
+
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "event_loop.h"
+#include "evdev.h"
+#include "trace.h"
+
+
+// Runs `Engine` directly on an evdev keyboard, below X (or without it): the device is grabbed
+// and everything is re-emitted through a virtual keyboard, with the physical dual-role keys
+// turned into their tap or hold keys (so no keymap changes are needed).
+// Unless the strategy is `HOLD_ON_OTHER_KEY_PRESS`, keys pressed while a dual-role key is undecided
+// are held back and re-emitted after the decision, so that e.g. a space typed fast still comes out
+// before the next letter.
+class EvdevDaemon: private Clock, private Output {
+public:
+    struct InitializationError: public std::exception {};
+
+public:
+    // `space_key_code` is an X key code, as for the X adapter.
+    // With a `trace_path`, the events and decisions are recorded there (see `trace.h`).
+    EvdevDaemon(
+        const std::string& device_path, KeyCode space_key_code, int timeout_millisec,
+        const EngineOptions& options = EngineOptions(), const std::string& trace_path = std::string());
+
+    void run();
+
+private:
+    Engine engine_;
+
+    EvdevDevice device_;
+    UinputKeyboard keyboard_;
+
+    EventLoop loop_;
+    // SIGINT and SIGTERM.
+    SignalSource signals_;
+    // Goes off when Space has been pressed for the timeout, see `Engine::commit_hold`.
+    Timer hold_timer_;
+    // Changes whenever `hold_timer_` is (re-)armed or disarmed.
+    unsigned hold_timer_generation_ = 0;
+
+    // The events delayed until Space is decided upon, see `Engine::holding_back`.
+    std::vector<input_event> held_back_events_;
+    // When the first of them was held back (by the engine clock).
+    Timestamp holdback_start_ = 0;
+
+    // How long the events are held back.
+    struct HoldbackStatistics {
+        unsigned long count = 0;
+        Timestamp total_microsec = 0;
+        Timestamp max_microsec = 0;
+    } holdback_statistics_;
+
+    // Left closed (and then recording nothing) unless tracing.
+    TraceWriter trace_;
+
+private:
+    bool initialize(const std::string& device_path);
+
+    void process_device_events();
+    void process_key(const input_event& event);
+    // Re-emits `event` unless it should be held back.
+    void pass(const input_event& event);
+    void release_held_back_events();
+    void report_holdback_statistics() const;
+    void handle_hold_timeout();
+    void handle_signals();
+
+    Timestamp now() override;
+    void tap(const DualRoleKey& key) override;
+    void hold(const DualRoleKey& key) override;
+    void release_hold(const DualRoleKey& key) override;
+    void schedule_hold(Timestamp microseconds) override;
+    void cancel_hold() override;
+};
+
+
+#endif  // SPACE2SUPER_EVDEV_DAEMON_H
@@ -0,0 +1,127 @@
+#include "event_loop.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+
+void FileDescriptor::reset(int fd) {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    fd_ = fd;
+}
+
+
+bool EventLoop::open() {
+    epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+    if (! epoll_fd_.valid()) {
+        std::cerr << "Could not create an epoll instance: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::watch(int fd, Handler handler) {
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = static_cast<std::uint32_t>(handlers_.size());
+
+    if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, fd, &event) != 0) {
+        std::cerr << "Could not watch file descriptor " << fd << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    handlers_.push_back(std::move(handler));
+    return true;
+}
+
+bool EventLoop::run() {
+    const int MAX_EVENTS = 8;
+    epoll_event events[MAX_EVENTS];
+
+    running_ = true;
+    while (running_) {
+        int ready = epoll_wait(epoll_fd_.get(), events, MAX_EVENTS, /* timeout */ -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Waiting for events failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        for (int index = 0; index < ready && running_; ++index) {
+            handlers_[events[index].data.u32]();
+        }
+    }
+    return true;
+}
+
+
+bool SignalSource::open(std::initializer_list<int> signal_numbers) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (int signal_number : signal_numbers) {
+        sigaddset(&signals, signal_number);
+    }
+
+    if (sigprocmask(SIG_BLOCK, &signals, nullptr) != 0) {
+        std::cerr << "Could not block signals: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    fd_.reset(signalfd(/* fd */ -1, &signals, SFD_NONBLOCK | SFD_CLOEXEC));
+    if (! fd_.valid()) {
+        std::cerr << "Could not create a signal file descriptor: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int SignalSource::read_signal() {
+    signalfd_siginfo info;
+    if (read(fd_.get(), &info, sizeof(info)) != sizeof(info)) {
+        return 0;
+    }
+    return static_cast<int>(info.ssi_signo);
+}
+
+
+bool Timer::open() {
+    fd_.reset(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    if (! fd_.valid()) {
+        std::cerr << "Could not create a timer file descriptor: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Timer::arm(Timestamp microseconds) {
+    itimerspec deadline;
+    std::memset(&deadline, 0, sizeof(deadline));
+    deadline.it_value.tv_sec = static_cast<time_t>(microseconds / 1000000);
+    deadline.it_value.tv_nsec = static_cast<long>(microseconds % 1000000) * 1000;
+    if (deadline.it_value.tv_sec == 0 && deadline.it_value.tv_nsec == 0) {
+        // All zeroes would disarm the timer instead.
+        deadline.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(fd_.get(), /* flags */ 0, &deadline, nullptr);
+}
+
+void Timer::disarm() {
+    itimerspec never;
+    std::memset(&never, 0, sizeof(never));
+    timerfd_settime(fd_.get(), /* flags */ 0, &never, nullptr);
+}
+
+bool Timer::acknowledge() {
+    std::uint64_t expirations;
+    return read(fd_.get(), &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0;
+}
@@ -0,0 +1,111 @@
+#ifndef SPACE2SUPER_EVENT_LOOP_H
+#define SPACE2SUPER_EVENT_LOOP_H
+
+/*
+    A single-threaded `epoll`-based event loop with `signalfd` and `timerfd` helpers,
+    so that the daemon can wait on several sources (X connections, signals, timers) at once
+    without blocking in any one of them and without busy-waiting.
+*/
+
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include <signal.h>
+
+#include "engine.h"
+
+
+// Owns a file descriptor, closing it on destruction.
+class FileDescriptor {
+public:
+    FileDescriptor() {}
+    explicit FileDescriptor(int fd): fd_(fd) {}
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    ~FileDescriptor() {
+        reset();
+    }
+
+    int get() const {
+        return fd_;
+    }
+
+    bool valid() const {
+        return fd_ >= 0;
+    }
+
+    void reset(int fd = -1);
+
+private:
+    int fd_ = -1;
+};
+
+
+class EventLoop {
+public:
+    typedef std::function<void()> Handler;
+
+public:
+    bool open();
+
+    // Calls `handler` whenever `fd` becomes readable.
+    bool watch(int fd, Handler handler);
+
+    // Dispatches handlers until `stop` is called (from one of them).
+    bool run();
+
+    void stop() {
+        running_ = false;
+    }
+
+private:
+    FileDescriptor epoll_fd_;
+    std::vector<Handler> handlers_;
+    bool running_ = false;
+};
+
+
+// Delivers the given signals as readable events instead of asynchronous handler calls.
+class SignalSource {
+public:
+    // Blocks the signals for the calling thread and the threads it spawns later, not for the threads
+    // that already exist (where the signals may still be delivered, with their default action),
+    // so it has to come before any other thread is started.
+    bool open(std::initializer_list<int> signal_numbers);
+
+    int fd() const {
+        return fd_.get();
+    }
+
+    // Returns the number of the next pending signal, or 0 if there is none.
+    int read_signal();
+
+private:
+    FileDescriptor fd_;
+};
+
+
+// A one-shot monotonic timer.
+class Timer {
+public:
+    bool open();
+
+    int fd() const {
+        return fd_.get();
+    }
+
+    // Re-arms the timer (cancelling the previous deadline) to expire in `microseconds`.
+    void arm(Timestamp microseconds);
+
+    void disarm();
+
+    // Consumes the expiration; returns whether the timer has indeed expired.
+    bool acknowledge();
+
+private:
+    FileDescriptor fd_;
+};
+
+
+#endif  // SPACE2SUPER_EVENT_LOOP_H
@@ -0,0 +1,136 @@
+/*
+    Compares the two ways of injecting a typed space with XTest on the current $DISPLAY:
+    * synchronous: every request is followed by a round trip (as with `XSynchronize`);
+    * batched: the press/release pair is queued and flushed once per tap (as `space2super` does).
+
+    Build and run with:
+        make injection-bench
+    Optionally pass the number of taps and the key code to fake (an unmapped one by default,
+    so that nothing gets typed into the focused window).
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XTest.h>
+
+
+namespace {
+
+typedef std::chrono::steady_clock SteadyClock;
+
+// The number of round trips made by the synchronous mode.
+int round_trips = 0;
+
+// Installed with `XSetAfterFunction`; this is what `XSynchronize` does, plus counting.
+int synchronize(Display* display) {
+    ++round_trips;
+    // The after function must not be invoked recursively by `XSync` itself.
+    int (*previous)(Display*) = XSetAfterFunction(display, nullptr);
+    XSync(display, /* discard */ False);
+    XSetAfterFunction(display, previous);
+    return 0;
+}
+
+KeyCode find_unmapped_key_code(Display* display) {
+    int min_key_code, max_key_code;
+    XDisplayKeycodes(display, &min_key_code, &max_key_code);
+    for (int key_code = max_key_code; key_code >= min_key_code; --key_code) {
+        if (XkbKeycodeToKeysym(display, static_cast<KeyCode>(key_code), /* group */ 0, /* shift */ 0) == NoSymbol) {
+            return static_cast<KeyCode>(key_code);
+        }
+    }
+    return 0;
+}
+
+struct Result {
+    int round_trips;
+    double mean_microsec;
+    double p99_microsec;
+    // Until the server has processed all the taps, per tap.
+    double total_microsec;
+};
+
+// Measures the time from starting the injection until it has left for the server
+// (synchronous: until the server has processed it).
+Result measure(Display* display, KeyCode key_code, int taps, bool synchronous) {
+    round_trips = 0;
+    if (synchronous) {
+        XSetAfterFunction(display, synchronize);
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(taps);
+    auto first_start = SteadyClock::now();
+    for (int tap = 0; tap < taps; ++tap) {
+        auto start = SteadyClock::now();
+        XTestFakeKeyEvent(display, key_code, True, CurrentTime);
+        XTestFakeKeyEvent(display, key_code, False, CurrentTime);
+        if (! synchronous) {
+            XFlush(display);
+        }
+        auto end = SteadyClock::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    XSetAfterFunction(display, nullptr);
+    XSync(display, /* discard */ False);
+    double total = std::chrono::duration<double, std::micro>(SteadyClock::now() - first_start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (double latency : latencies) {
+        sum += latency;
+    }
+    return {round_trips, sum / taps, latencies[latencies.size() * 99 / 100], total / taps};
+}
+
+void report(const char* mode, const Result& result, int taps) {
+    std::cout << mode << ": " <<
+        static_cast<double>(result.round_trips) / taps << " round trips/tap, " <<
+        "injection mean " << result.mean_microsec << " us, p99 " << result.p99_microsec << " us; " <<
+        "until processed " << result.total_microsec << " us/tap" << std::endl;
+}
+
+}  // namespace
+
+
+int main(const int argc, const char* argv[]) {
+    int taps = argc > 1 ? atoi(argv[1]) : 10000;
+    if (taps <= 0) {
+        std::cerr << "The number of taps should be positive." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Display* display = XOpenDisplay(/* display_name */ nullptr);
+    if (display == nullptr) {
+        std::cerr << "Could not open the default display (not running under X11?)." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int unused;
+    if (! XTestQueryExtension(display, &unused, &unused, &unused, &unused)) {
+        std::cerr << "The XTest extension has not been loaded by the X server." << std::endl;
+        XCloseDisplay(display);
+        return EXIT_FAILURE;
+    }
+
+    KeyCode key_code = argc > 2 ? static_cast<KeyCode>(atoi(argv[2])) : find_unmapped_key_code(display);
+    if (key_code == 0) {
+        std::cerr << "No unmapped key code found, please pass one explicitly." << std::endl;
+        XCloseDisplay(display);
+        return EXIT_FAILURE;
+    }
+    std::cout << "Faking " << taps << " taps of key code " << static_cast<int>(key_code) << std::endl;
+
+    report("synchronous", measure(display, key_code, taps, /* synchronous */ true), taps);
+    report("batched    ", measure(display, key_code, taps, /* synchronous */ false), taps);
+
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
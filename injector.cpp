@@ -0,0 +1,122 @@
+#include "injector.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <X11/extensions/XTest.h>
+
+#include "log.h"
+
+
+bool Injector::start() {
+    display_ = XOpenDisplay(/* display_name */ nullptr);  // $DISPLAY by default.
+    if (display_ == nullptr) {
+        std::cerr << "Could not open the injection connection to the default display." << std::endl;
+        return false;
+    }
+
+    wakeup_.reset(eventfd(/* initval */ 0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (! wakeup_.valid()) {
+        std::cerr << "Could not create an event file descriptor: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    thread_ = std::thread(&Injector::run, this);
+    return true;
+}
+
+void Injector::stop() {
+    if (thread_.joinable()) {
+        stopping_.store(true, std::memory_order_release);
+        wake_up();
+        thread_.join();
+    }
+    if (display_ != nullptr) {
+        XCloseDisplay(display_);
+        display_ = nullptr;
+    }
+}
+
+bool Injector::tap(KeyCode key_code) {
+    if (! queue_.push({key_code, true})) {
+        return false;
+    }
+    // Once the press has got through, the release must follow it no matter what.
+    while (! queue_.push({key_code, false})) {
+        std::this_thread::yield();
+    }
+    wake_up();
+    return true;
+}
+
+bool Injector::send(KeyCode key_code, bool is_press) {
+    if (! queue_.push({key_code, is_press})) {
+        return false;
+    }
+    wake_up();
+    return true;
+}
+
+void Injector::wake_up() {
+    std::uint64_t increment = 1;
+    // Can only fail if the counter would overflow, i.e. when a wakeup is pending anyway.
+    ssize_t written = write(wakeup_.get(), &increment, sizeof(increment));
+    (void)written;
+}
+
+bool Injector::inject_queued() {
+    bool injected = false;
+    FakeKeyEvent event;
+    while (queue_.pop(event)) {
+        XTestFakeKeyEvent(display_, event.key_code, event.is_press ? True : False, CurrentTime);
+        injected = true;
+    }
+    if (injected) {
+        XFlush(display_);
+    }
+    return injected;
+}
+
+void Injector::run() {
+    LOG("Injection thread started.");
+
+    pollfd sources[] = {
+        {wakeup_.get(), POLLIN, 0},
+        // Only errors are expected from the server, reported by the Xlib error handler.
+        {ConnectionNumber(display_), POLLIN, 0},
+    };
+
+    for (;;) {
+        inject_queued();
+        if (stopping_.load(std::memory_order_acquire)) {
+            // Whatever was queued before stopping has just been sent.
+            break;
+        }
+
+        if (poll(sources, /* nfds */ 2, /* timeout */ -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "The injection thread failed to wait: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (sources[0].revents & POLLIN) {
+            std::uint64_t wakeups;
+            ssize_t read_size = read(wakeup_.get(), &wakeups, sizeof(wakeups));
+            (void)read_size;  // Resets the counter; the queue is the source of truth.
+        }
+        if (sources[1].revents & POLLIN) {
+            XPending(display_);
+        }
+    }
+
+    XSync(display_, /* discard */ False);
+    LOG("Injection thread finished.");
+}
@@ -0,0 +1,59 @@
+#ifndef SPACE2SUPER_INJECTOR_H
+#define SPACE2SUPER_INJECTOR_H
+
+#include <atomic>
+#include <thread>
+
+#include <X11/Xlib.h>
+
+#include "event_loop.h"
+#include "spsc_queue.h"
+
+
+// Injects fake key events with XTest on its own X connection from its own thread,
+// so that the recording side only enqueues them and never waits for the server.
+class Injector {
+public:
+    Injector() {}
+    Injector(const Injector&) = delete;
+    Injector& operator=(const Injector&) = delete;
+    ~Injector() {
+        stop();
+    }
+
+    bool start();
+    void stop();
+
+    // Producer side (one thread only): queues a press and a release of `key_code`.
+    // Returns false if the queue is full.
+    bool tap(KeyCode key_code);
+
+    // Producer side too: queues a press or a release alone.
+    bool send(KeyCode key_code, bool is_press);
+
+private:
+    struct FakeKeyEvent {
+        KeyCode key_code;
+        bool is_press;
+    };
+
+    // Typing bursts are far shorter than that.
+    static const std::size_t QUEUE_CAPACITY = 1024;
+
+private:
+    Display* display_ = nullptr;
+    // An `eventfd` waking the injection thread up.
+    FileDescriptor wakeup_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    SpscQueue<FakeKeyEvent, QUEUE_CAPACITY> queue_;
+
+private:
+    void wake_up();
+    void run();
+    // Sends all the queued events at once; returns whether there were any.
+    bool inject_queued();
+};
+
+
+#endif  // SPACE2SUPER_INJECTOR_H
@@ -0,0 +1,176 @@
+#include "keymap.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <X11/XKBlib.h>
+#include <X11/Xutil.h>
+
+
+namespace {
+
+KeyClass classify(KeySym key_sym, bool in_modifier_map) {
+    if (in_modifier_map || IsModifierKey(key_sym)) {
+        return KEY_CLASS_MODIFIER;
+    }
+    if (key_sym == NoSymbol) {
+        return KEY_CLASS_NONE;
+    }
+    // The legacy character sets lie below the dead keys and the function keys (0xfe00 on),
+    // and Unicode keysyms are offset by 0x01000000.
+    if (key_sym < 0xfe00 || (key_sym & 0xff000000) == 0x01000000) {
+        return KEY_CLASS_LETTER;
+    }
+    return KEY_CLASS_FUNCTION;
+}
+
+bool is_dual_role(KeyCode key_code, const std::vector<DualRoleKey>& keys) {
+    for (const DualRoleKey& key : keys) {
+        if (key.key_code == key_code) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+
+bool Keymap::load(Display* display) {
+    XkbDescPtr keyboard = XkbGetMap(display, XkbKeyTypesMask | XkbKeySymsMask | XkbModifierMapMask, XkbUseCoreKbd);
+    if (keyboard == nullptr) {
+        std::cerr << "Could not get the keyboard mapping." << std::endl;
+        return false;
+    }
+
+    min_key_code_ = keyboard->min_key_code;
+    max_key_code_ = keyboard->max_key_code;
+    for (int key_code = 0; key_code < 256; ++key_code) {
+        Key& key = keys_[key_code];
+        key = Key();
+        if (key_code < keyboard->min_key_code || key_code > keyboard->max_key_code) {
+            continue;
+        }
+        if (XkbKeyNumGroups(keyboard, key_code) > 0) {
+            key.key_sym = XkbKeySymEntry(keyboard, key_code, /* shift level */ 0, /* group */ 0);
+        }
+        key.key_class = classify(key.key_sym, keyboard->map->modmap[key_code] != 0);
+        if (const char* name = XKeysymToString(key.key_sym)) {
+            key.name = name;
+        }
+    }
+
+    XkbFreeKeyboard(keyboard, /* which */ 0, /* free_all */ True);
+    return true;
+}
+
+KeyCode Keymap::key_code(KeySym key_sym) const {
+    for (int key_code = 1; key_code < 256; ++key_code) {
+        if (keys_[key_code].key_sym == key_sym) {
+            return static_cast<KeyCode>(key_code);
+        }
+    }
+    return 0;
+}
+
+KeyCode Keymap::spare_key_code(int below) const {
+    for (int key_code = (below <= max_key_code_ ? below - 1 : max_key_code_); key_code >= min_key_code_; --key_code) {
+        if (keys_[key_code].key_sym == NoSymbol && keys_[key_code].key_class == KEY_CLASS_NONE) {
+            return static_cast<KeyCode>(key_code);
+        }
+    }
+    return 0;
+}
+
+bool Remapping::apply(Display* display, const Keymap& keymap, const std::vector<DualRoleKey>& keys) {
+    std::vector<Row> rows;
+    for (const DualRoleKey& key : keys) {
+        if (keymap.key(key.key_code).key_sym != key.hold) {
+            rows.push_back({key.key_code, {key.hold}});
+        }
+    }
+
+    int spare_below = 256;
+    for (const DualRoleKey& key : keys) {
+        KeyCode tap_key_code = keymap.key_code(key.tap);
+        if (tap_key_code != 0 && ! is_dual_role(tap_key_code, keys)) {
+            continue;
+        }
+        bool assigned = std::any_of(rows.begin(), rows.end(),
+            [&key](const Row& row) { return row.key_syms[0] == key.tap; });
+        if (assigned) {
+            continue;
+        }
+
+        KeyCode spare_key_code;
+        do {
+            spare_key_code = keymap.spare_key_code(spare_below);
+            spare_below = spare_key_code;
+        } while (spare_key_code != 0 && is_dual_role(spare_key_code, keys));
+        if (spare_key_code == 0) {
+            std::cerr << "No spare key code left to type `" << key_symbol_name(key.tap) << "`." << std::endl;
+            return false;
+        }
+        rows.push_back({spare_key_code, {key.tap}});
+    }
+
+    return rows.empty() || change_rows(display, rows, /* record_originals */ true);
+}
+
+bool Remapping::restore(Display* display) {
+    if (original_rows_.empty()) {
+        return true;
+    }
+    bool restored = change_rows(display, original_rows_, /* record_originals */ false);
+    // The connection may be closed right after.
+    XSync(display, /* discard */ False);
+    original_rows_.clear();
+    return restored;
+}
+
+bool Remapping::change_rows(Display* display, const std::vector<Row>& rows, bool record_originals) {
+    int first_key_code = 255;
+    int last_key_code = 0;
+    for (const Row& row : rows) {
+        first_key_code = std::min<int>(first_key_code, row.key_code);
+        last_key_code = std::max<int>(last_key_code, row.key_code);
+    }
+    int key_code_count = last_key_code - first_key_code + 1;
+
+    // Read in a single request, which leaves the rows in between alone.
+    int current_width = 0;
+    KeySym* current = XGetKeyboardMapping(
+        display, static_cast<KeyCode>(first_key_code), key_code_count, &current_width
+    );
+    if (current == nullptr) {
+        std::cerr << "Could not get the key code mapping." << std::endl;
+        return false;
+    }
+
+    for (const Row& row : rows) {
+        const KeySym* current_row = current + (row.key_code - first_key_code) * current_width;
+        std::vector<KeySym> key_syms(current_row, current_row + current_width);
+        bool recorded = std::any_of(original_rows_.begin(), original_rows_.end(),
+            [&row](const Row& original) { return original.key_code == row.key_code; });
+        if (record_originals && ! recorded) {
+            original_rows_.push_back({row.key_code, key_syms});
+        }
+
+        KeySym replaced = key_syms.empty() ? NoSymbol : key_syms[0];
+        if (key_syms.size() < row.key_syms.size()) {
+            key_syms.resize(row.key_syms.size(), NoSymbol);
+        }
+        // The second group starts at the third column; a key typing the same in it would otherwise keep typing that.
+        for (std::size_t column = std::max<std::size_t>(2, row.key_syms.size()); column < key_syms.size(); ++column) {
+            if (column % 2 == 0 && replaced != NoSymbol && key_syms[column] == replaced) {
+                key_syms[column] = row.key_syms[0];
+            }
+        }
+        std::copy(row.key_syms.begin(), row.key_syms.end(), key_syms.begin());
+
+        // One key code per request, see the class comment.
+        XChangeKeyboardMapping(display, row.key_code, static_cast<int>(key_syms.size()), key_syms.data(), 1);
+    }
+    XFree(current);
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef SPACE2SUPER_KEYMAP_H
+#define SPACE2SUPER_KEYMAP_H
+
+#include <string>
+#include <vector>
+
+#include <X11/Xlib.h>
+
+#include "engine.h"
+
+
+// What the keys are for, as far as telling chords from typing is concerned.
+enum KeyClass {
+    // Types nothing.
+    KEY_CLASS_NONE,
+    // In the modifier map, or a modifier keysym (Shift, Control etc.).
+    KEY_CLASS_MODIFIER,
+    // Types a character.
+    KEY_CLASS_LETTER,
+    // Anything else: function, cursor and editing keys and the like.
+    KEY_CLASS_FUNCTION,
+};
+
+// What every key code types without modifiers in the first group, fetched with a single `XkbGetMap`
+// request and kept until `load` is called again on a keymap change,
+// so that key metadata never costs a round trip to the server per event.
+class Keymap {
+public:
+    struct Key {
+        KeySym key_sym = NoSymbol;
+        KeyClass key_class = KEY_CLASS_NONE;
+        // As given by `XKeysymToString`.
+        std::string name = "NoSymbol";
+    };
+
+public:
+    // Keeps the previous table on failure.
+    bool load(Display* display);
+
+    const Key& key(KeyCode key_code) const {
+        return keys_[key_code];
+    }
+
+    // The lowest key code typing `key_sym` without modifiers, or 0.
+    KeyCode key_code(KeySym key_sym) const;
+
+    // The highest key code of the keyboard below `below` which types nothing, or 0.
+    KeyCode spare_key_code(int below = 256) const;
+
+private:
+    Key keys_[256];
+    int min_key_code_ = 0;
+    int max_key_code_ = -1;
+};
+
+
+// Makes the dual-role keys act as their hold keysyms, and spare key codes type those tap keysyms
+// which no other key types, remembering the replaced rows so that `restore` puts them back.
+// Each key code is changed on its own and in as few columns as needed: the server rebuilds the XKB types
+// and groups of every key code sent in a core mapping change, which would flatten the other keys' layouts.
+class Remapping {
+public:
+    // On top of `keymap` as loaded from `display` last; again after keymap changes (e.g. by `setxkbmap`),
+    // when rows already replaced once keep their first original.
+    // Returns false on failure (nothing is changed then).
+    bool apply(Display* display, const Keymap& keymap, const std::vector<DualRoleKey>& keys);
+
+    bool restore(Display* display);
+
+private:
+    struct Row {
+        KeyCode key_code;
+        std::vector<KeySym> key_syms;
+    };
+
+private:
+    // Replaced by `apply`, by key code.
+    std::vector<Row> original_rows_;
+
+private:
+    // Replaces the first columns of the rows of the key codes of `rows`, and the first level of the other groups
+    // where it repeats the replaced keysym, keeping the other columns; records the replaced rows if asked to.
+    bool change_rows(Display* display, const std::vector<Row>& rows, bool record_originals);
+};
+
+
+#endif  // SPACE2SUPER_KEYMAP_H
@@ -0,0 +1,52 @@
+#include "keysyms.h"
+
+#include <cstring>
+
+
+namespace {
+
+struct NamedKeySymbol {
+    const char* name;
+    KeySymbol key_symbol;
+};
+
+const NamedKeySymbol KEY_SYMBOLS[] = {
+    {"space", KEY_SYMBOL_SPACE},
+    {"BackSpace", KEY_SYMBOL_BACKSPACE},
+    {"Tab", KEY_SYMBOL_TAB},
+    {"Return", KEY_SYMBOL_RETURN},
+    {"Escape", KEY_SYMBOL_ESCAPE},
+    {"Menu", KEY_SYMBOL_MENU},
+    {"Delete", KEY_SYMBOL_DELETE},
+    {"Shift_L", KEY_SYMBOL_SHIFT_L},
+    {"Shift_R", KEY_SYMBOL_SHIFT_R},
+    {"Control_L", KEY_SYMBOL_CONTROL_L},
+    {"Control_R", KEY_SYMBOL_CONTROL_R},
+    {"Caps_Lock", KEY_SYMBOL_CAPS_LOCK},
+    {"Alt_L", KEY_SYMBOL_ALT_L},
+    {"Alt_R", KEY_SYMBOL_ALT_R},
+    {"Super_L", KEY_SYMBOL_SUPER_L},
+    {"Super_R", KEY_SYMBOL_SUPER_R},
+    {"ISO_Level3_Shift", KEY_SYMBOL_ISO_LEVEL3_SHIFT},
+};
+
+}  // namespace
+
+
+KeySymbol key_symbol_from_name(const char* name) {
+    for (const NamedKeySymbol& named : KEY_SYMBOLS) {
+        if (std::strcmp(named.name, name) == 0) {
+            return named.key_symbol;
+        }
+    }
+    return NO_KEY_SYMBOL;
+}
+
+const char* key_symbol_name(KeySymbol key_symbol) {
+    for (const NamedKeySymbol& named : KEY_SYMBOLS) {
+        if (named.key_symbol == key_symbol) {
+            return named.name;
+        }
+    }
+    return nullptr;
+}
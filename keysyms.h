@@ -0,0 +1,41 @@
+#ifndef SPACE2SUPER_KEYSYMS_H
+#define SPACE2SUPER_KEYSYMS_H
+
+/*
+    The X keysyms (values as in X11/keysymdef.h) that dual-role keys can type or act as,
+    by name, so that the X-independent parts (the engine, its options, the evdev backend)
+    can refer to them.
+*/
+
+#include <cstdint>
+
+
+typedef std::uint32_t KeySymbol;
+
+const KeySymbol NO_KEY_SYMBOL = 0;
+const KeySymbol KEY_SYMBOL_SPACE = 0x0020;
+const KeySymbol KEY_SYMBOL_BACKSPACE = 0xff08;
+const KeySymbol KEY_SYMBOL_TAB = 0xff09;
+const KeySymbol KEY_SYMBOL_RETURN = 0xff0d;
+const KeySymbol KEY_SYMBOL_ESCAPE = 0xff1b;
+const KeySymbol KEY_SYMBOL_MENU = 0xff67;
+const KeySymbol KEY_SYMBOL_DELETE = 0xffff;
+const KeySymbol KEY_SYMBOL_SHIFT_L = 0xffe1;
+const KeySymbol KEY_SYMBOL_SHIFT_R = 0xffe2;
+const KeySymbol KEY_SYMBOL_CONTROL_L = 0xffe3;
+const KeySymbol KEY_SYMBOL_CONTROL_R = 0xffe4;
+const KeySymbol KEY_SYMBOL_CAPS_LOCK = 0xffe5;
+const KeySymbol KEY_SYMBOL_ALT_L = 0xffe9;
+const KeySymbol KEY_SYMBOL_ALT_R = 0xffea;
+const KeySymbol KEY_SYMBOL_SUPER_L = 0xffeb;
+const KeySymbol KEY_SYMBOL_SUPER_R = 0xffec;
+const KeySymbol KEY_SYMBOL_ISO_LEVEL3_SHIFT = 0xfe03;
+
+// E.g. "space", "Escape", "Control_L"; returns `NO_KEY_SYMBOL` for names outside the supported set.
+KeySymbol key_symbol_from_name(const char* name);
+
+// Returns nullptr for keysyms outside the supported set.
+const char* key_symbol_name(KeySymbol key_symbol);
+
+
+#endif  // SPACE2SUPER_KEYSYMS_H
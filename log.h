@@ -0,0 +1,14 @@
+#ifndef SPACE2SUPER_LOG_H
+#define SPACE2SUPER_LOG_H
+
+#include <iostream>
+
+
+#ifndef NDEBUG
+    #define LOG(x) std::clog << x << std::endl;
+#else
+    #define LOG(x)
+#endif
+
+
+#endif  // SPACE2SUPER_LOG_H
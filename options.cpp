@@ -0,0 +1,111 @@
+#include "options.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+// Returns the value of `argument` if it is `--NAME=...`, `nullptr` otherwise.
+const char* option_value(const char* argument, const char* name) {
+    std::size_t length = std::strlen(name);
+    if (std::strncmp(argument, "--", 2) != 0 || std::strncmp(argument + 2, name, length) != 0 ||
+        argument[2 + length] != '=')
+    {
+        return nullptr;
+    }
+    return argument + 2 + length + 1;
+}
+
+bool parse_strategy(const char* value, TapHoldStrategy& strategy) {
+    if (std::strcmp(value, "hold-on-other-key-press") == 0) {
+        strategy = HOLD_ON_OTHER_KEY_PRESS;
+    } else if (std::strcmp(value, "permissive-hold") == 0) {
+        strategy = PERMISSIVE_HOLD;
+    } else if (std::strcmp(value, "tap-preferred") == 0) {
+        strategy = TAP_PREFERRED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// KEYCODE:TAP:HOLD[:TIMEOUT[:STRATEGY]]
+bool parse_key(const char* value, DualRoleKey& key) {
+    std::vector<std::string> fields;
+    std::istringstream stream(value);
+    std::string field;
+    while (std::getline(stream, field, ':')) {
+        fields.push_back(field);
+    }
+    if (fields.size() < 3 || fields.size() > 5) {
+        return false;
+    }
+
+    int key_code;
+    if (! parse_count(fields[0].c_str(), key_code) || key_code == 0 || key_code > 0xff) {
+        return false;
+    }
+    key.key_code = static_cast<KeyCode>(key_code);
+    key.tap = key_symbol_from_name(fields[1].c_str());
+    key.hold = key_symbol_from_name(fields[2].c_str());
+    if (key.tap == NO_KEY_SYMBOL || key.hold == NO_KEY_SYMBOL) {
+        return false;
+    }
+    if (fields.size() >= 4 && ! parse_count(fields[3].c_str(), key.timeout_millisec)) {
+        return false;
+    }
+    if (fields.size() == 5) {
+        key.has_strategy = true;
+        return parse_strategy(fields[4].c_str(), key.strategy);
+    }
+    return true;
+}
+
+}  // namespace
+
+
+bool parse_count(const char* value, int& count) {
+    char* end;
+    long parsed = std::strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || parsed < 0 || parsed > 1000000) {
+        return false;
+    }
+    count = static_cast<int>(parsed);
+    return true;
+}
+
+bool parse_engine_option(const char* argument, EngineOptions& options) {
+    const char* value;
+    bool valid;
+
+    if ((value = option_value(argument, "strategy")) != nullptr) {
+        valid = parse_strategy(value, options.strategy);
+    } else if ((value = option_value(argument, "key")) != nullptr) {
+        DualRoleKey key;
+        valid = parse_key(value, key);
+        if (valid) {
+            options.keys.push_back(key);
+        }
+    } else if ((value = option_value(argument, "hold-commit")) != nullptr) {
+        valid = parse_count(value, options.hold_commit_millisec);
+    } else if ((value = option_value(argument, "rollover-overlap")) != nullptr) {
+        valid = parse_count(value, options.rollover_overlap_millisec);
+    } else if ((value = option_value(argument, "rollover-keys")) != nullptr) {
+        valid = parse_count(value, options.max_rollover_keys);
+    } else if ((value = option_value(argument, "typing-streak")) != nullptr) {
+        valid = parse_count(value, options.typing_streak_millisec);
+    } else {
+        std::cerr << "Unknown option: " << argument << std::endl;
+        return false;
+    }
+
+    if (! valid) {
+        std::cerr << "Invalid value in " << argument << std::endl;
+    }
+    return valid;
+}
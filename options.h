@@ -0,0 +1,22 @@
+#ifndef SPACE2SUPER_OPTIONS_H
+#define SPACE2SUPER_OPTIONS_H
+
+#include "engine.h"
+
+
+// Parses a `--NAME=VALUE` command line option into `options`:
+//     --strategy=hold-on-other-key-press|permissive-hold|tap-preferred
+//     --hold-commit=MILLISECONDS
+//     --rollover-overlap=MILLISECONDS
+//     --rollover-keys=COUNT
+//     --typing-streak=MILLISECONDS
+//     --key=KEYCODE:TAP:HOLD[:TIMEOUT[:STRATEGY]] (repeatable; keysym names as in `keysyms.h`)
+// Reports invalid ones to `std::cerr`.
+bool parse_engine_option(const char* argument, EngineOptions& options);
+
+// Parses a whole decimal number from 0 to 1000000 (as the option values are) into `count`;
+// returns false for anything else.
+bool parse_count(const char* value, int& count);
+
+
+#endif  // SPACE2SUPER_OPTIONS_H
@@ -0,0 +1,159 @@
+/*
+    Replays an event trace recorded with `--trace=PATH` (see `trace.h`) through the engine
+    and prints the decisions it makes, one per line:
+        MICROSECONDS tap|hold|release-hold KEYCODE
+    with the time counted from the first event, so that the output of engine versions and options
+    can be diffed on the same input. A summary (throughput, and whether the decisions match the recorded ones)
+    goes to the standard error.
+
+    Build with:
+        make space2super-replay
+    and run as:
+        ./space2super-replay [--realtime] TRACE KEYCODE TIMEOUT [ENGINE OPTIONS]
+    with the arguments the daemon had (see `options.h`). The events are fed as fast as possible,
+    or with `--realtime`, paced by their timestamps (the untimed ones then taking the replay clock).
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "options.h"
+#include "trace.h"
+#include "trace_replay.h"
+
+
+namespace {
+
+typedef std::chrono::steady_clock SteadyClock;
+
+bool is_decision(const TraceRecord& record) {
+    return record.kind == TRACE_TAP || record.kind == TRACE_HOLD || record.kind == TRACE_RELEASE_HOLD;
+}
+
+// Sleeps until the trace time `moment`, with the replay started at `start` from `trace_start`.
+void wait_until(Timestamp moment, Timestamp trace_start, SteadyClock::time_point start) {
+    std::this_thread::sleep_until(start + std::chrono::microseconds(moment - trace_start));
+}
+
+void replay_in_real_time(TraceReplay& replay, const std::vector<TraceRecord>& records, Timestamp trace_start) {
+    SteadyClock::time_point start = SteadyClock::now();
+    for (const TraceRecord& record : records) {
+        if (is_decision(record)) {
+            continue;
+        }
+        if (record.time != NO_TIME) {
+            while (replay.hold_deadline() != NO_TIME && replay.hold_deadline() < record.time) {
+                wait_until(replay.hold_deadline(), trace_start, start);
+                replay.commit_hold();
+            }
+            wait_until(record.time, trace_start, start);
+        } else {
+            replay.set_now(trace_start + std::chrono::duration_cast<std::chrono::microseconds>(
+                SteadyClock::now() - start).count());
+        }
+        replay.feed(record);
+    }
+    if (replay.hold_deadline() != NO_TIME) {
+        wait_until(replay.hold_deadline(), trace_start, start);
+        replay.commit_hold();
+    }
+}
+
+// Reports the throughput, which includes simulating the hold timer.
+void replay_fast(TraceReplay& replay, const std::vector<TraceRecord>& records) {
+    std::size_t events = 0;
+    SteadyClock::time_point start = SteadyClock::now();
+    for (const TraceRecord& record : records) {
+        if (! is_decision(record)) {
+            replay.feed(record);
+            ++events;
+        }
+    }
+    replay.commit_hold();
+    double seconds = std::chrono::duration<double>(SteadyClock::now() - start).count();
+
+    std::cerr << "Replayed " << events << " events in " << seconds * 1000 << " ms: ";
+    if (events > 0 && seconds > 0) {
+        std::cerr << events / seconds / 1e6 << " M events/s, " << seconds / events * 1e9 << " ns/event";
+    }
+    std::cerr << std::endl;
+}
+
+// Compares what has been decided, not when (recorded decisions carry the time of the event before them).
+void compare_decisions(const std::vector<TraceRecord>& records, const std::vector<TraceRecord>& decisions) {
+    std::vector<TraceRecord> recorded;
+    for (const TraceRecord& record : records) {
+        if (is_decision(record)) {
+            recorded.push_back(record);
+        }
+    }
+
+    std::size_t index = 0;
+    while (index < recorded.size() && index < decisions.size() &&
+        recorded[index].kind == decisions[index].kind && recorded[index].key_code == decisions[index].key_code)
+    {
+        ++index;
+    }
+    std::cerr << decisions.size() << " decisions, " << recorded.size() << " recorded";
+    if (index == recorded.size() && index == decisions.size()) {
+        std::cerr << ", all the same." << std::endl;
+    } else {
+        std::cerr << ", the same up to #" << index + 1 << "." << std::endl;
+    }
+}
+
+}  // namespace
+
+
+int main(const int argc, const char* argv[]) {
+    std::vector<const char*> arguments;
+    EngineOptions options;
+    bool realtime = false;
+    for (int index = 1; index < argc; ++index) {
+        if (std::strncmp(argv[index], "--", 2) != 0) {
+            arguments.push_back(argv[index]);
+        } else if (std::strcmp(argv[index], "--realtime") == 0) {
+            realtime = true;
+        } else if (! parse_engine_option(argv[index], options)) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (arguments.size() != 3) {
+        std::cerr << "Usage: " << argv[0] << " [--realtime] TRACE KEYCODE TIMEOUT [ENGINE OPTIONS]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<TraceRecord> records;
+    if (! read_trace(arguments[0], records)) {
+        return EXIT_FAILURE;
+    }
+    Timestamp trace_start = 0;
+    for (const TraceRecord& record : records) {
+        if (record.time != NO_TIME) {
+            trace_start = record.time;
+            break;
+        }
+    }
+
+    TraceReplay replay(static_cast<KeyCode>(atoi(arguments[1])), atoi(arguments[2]), options);
+    replay.set_now(trace_start);
+    if (realtime) {
+        replay_in_real_time(replay, records, trace_start);
+    } else {
+        replay_fast(replay, records);
+    }
+
+    for (const TraceRecord& decision : replay.decisions()) {
+        std::cout << decision.time - trace_start << ' ' << trace_record_kind_name(decision.kind) << ' ' <<
+            static_cast<int>(decision.key_code) << '\n';
+    }
+    std::cout << std::flush;
+    compare_decisions(records, replay.decisions());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+#ifndef SPACE2SUPER_SERVER_TIME_H
+#define SPACE2SUPER_SERVER_TIME_H
+
+#include <cstdint>
+
+#include "engine.h"
+
+
+// Extends the 32-bit millisecond X server time, which wraps around every ~49.7 days,
+// into engine `Timestamp`s. Neighbouring events are assumed to be less than ~24.8 days apart.
+class ServerTime {
+public:
+    Timestamp extend(std::uint32_t millisec) {
+        if (! started_) {
+            started_ = true;
+            // Start a whole wraparound period in so that the result stays positive
+            // (and distinct from `NO_TIME`) even if the time goes slightly backwards.
+            extended_millisec_ = (static_cast<std::uint64_t>(1) << 32) + millisec;
+        } else {
+            extended_millisec_ += static_cast<std::int32_t>(millisec - last_millisec_);
+        }
+        last_millisec_ = millisec;
+        return extended_millisec_ * 1000;
+    }
+
+private:
+    bool started_ = false;
+    std::uint32_t last_millisec_ = 0;
+    std::uint64_t extended_millisec_ = 0;
+};
+
+
+#endif  // SPACE2SUPER_SERVER_TIME_H
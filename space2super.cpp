@@ -1,79 +1,103 @@
 /*
-    Compile with:
-        g++ -std=c++11 -o space2super space2super.cpp -W -Wall -L/usr/X11R6/lib -lX11 -lXtst
-    or equivalently:
+    Build with:
         make
-
-    To install libXTst in Ubuntu:
-        sudo apt-get install libxtst-dev
+    after installing the development packages of libXtst, libXi and xcb-record in Ubuntu:
+        sudo apt-get install libxtst-dev libxi-dev libxcb-record0-dev
     or equivalently:
         make deps
 
-    Needs the XRecord extension installed.
-    Try adding the following line into the `Module` section of /etc/X11/xorg.conf:
+    The xrecord and xcb backends need the XRecord extension of the X server.
+    If it is missing, try adding the following line into the `Module` section of /etc/X11/xorg.conf:
         Load    "record"
 
+    The recording is done by a backend chosen on startup (see `backend.h`):
+        xrecord: the Xlib XRecord API (default);
+        xcb: XRecord through XCB, parsing the batched replies in place;
+        xinput: XInput 2 raw events, for X servers without XRecord;
+        grab: xinput with no keymap changes: the dual-role keys are grabbed with XInput 2 on the physical
+            keyboards, and whatever they turn into, as well as the keys pressed meanwhile, is injected with XTest;
+        evdev: below X, on a grabbed Linux input device given as the next argument
+            and re-emitted through uinput (see `evdev_daemon.h`); needs no keymap changes.
+
+    The positional arguments may be followed by engine options (see `options.h`)
+    and by `--trace=PATH` to record the events and decisions into a ring file (see `trace.h`).
+
     X Record API documentation is available at:
         https://www.xfree86.org/current/recordlib.pdf
     X Keyboard Extension (XKB) API documentation is available at:
         https://www.xfree86.org/current/XKBproto.pdf
 */
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <iostream>
-#include <limits>
 #include <memory>
 #include <stdexcept>
-#include <type_traits>
+#include <string>
+#include <vector>
 
-#include <sys/time.h>
 #include <signal.h>
+#include <time.h>
 
-#include <X11/Xlibint.h>
+#include <X11/Xlib.h>
 #include <X11/keysym.h>
-#include <X11/extensions/record.h>
 #include <X11/extensions/XTest.h>
 #include <X11/XKBlib.h>
 
-// Defined in Xlibint.h.
-#undef min
-#undef max
-
-
-#ifndef NDEBUG
-    #define LOG(x) std::clog << x << std::endl;
-#else
-    #define LOG(x)
-#endif
+#include "backend.h"
+#include "engine.h"
+#include "evdev_daemon.h"
+#include "event_loop.h"
+#include "injector.h"
+#include "keymap.h"
+#include "log.h"
+#include "options.h"
+#include "server_time.h"
+#include "trace.h"
+#include "x_error.h"
 
 
 const char* DRIVER = "s2sctl";
 
+// How long to wait for the end of recorded data after requesting it on shutdown.
+const Timestamp SHUTDOWN_TIMEOUT_MICROSEC = 500000;
 
-class Space2Super {
+// The X adapter over `Engine`: feeds it with the events recorded by a `Backend`
+// and types the tapped dual-role keys with XTest.
+class Space2Super: private Clock, private Output, private EventSink {
 public:
     struct InitializationError: public std::exception {};
 
 public:
-    Space2Super(KeyCode original_space_key_code, int timeout_millisec):
-        original_space_key_code_(original_space_key_code),
-        timeout_millisec_(timeout_millisec)
+    // With `grab`, the keymap is left alone and the dual-role keys are grabbed instead (see `Backend::grab_keys`).
+    // With a `trace_path`, the events and decisions are recorded there (see `trace.h`).
+    Space2Super(
+        KeyCode original_space_key_code, int timeout_millisec, const EngineOptions& options,
+        std::unique_ptr<Backend> backend, bool grab, const std::string& trace_path
+    ):
+        engine_(original_space_key_code, timeout_millisec, *this, *this, options),
+        backend_(std::move(backend)),
+        grabbing_(grab)
     {
-        if (! initialize()) {
+        if ((! trace_path.empty() && ! trace_.open(trace_path)) || ! initialize()) {
             throw InitializationError();
         }
     }
 
+    ~Space2Super() {
+        restore_keyboard();
+    }
+
     void run() {
         if (! start_loop()) {
             throw InitializationError();
         }
-    }
-
-    ~Space2Super() {
-        stop();
+        if (engine_.suppressed_repeats() > 0) {
+            std::clog << "Ignored " << engine_.suppressed_repeats() << " autorepeated key presses." << std::endl;
+        }
     }
 
 private:
@@ -84,50 +108,68 @@ private:
         }
     };
 
-    class XObjectDestructor {
-    public:
-        void operator()(void* object) {
-            XFree(object);
-        }
-    };
-
-    class XRecordInterceptDataDestructor {
-    public:
-        void operator()(XRecordInterceptData* intercept_data) {
-            XRecordFreeData(intercept_data);
-        }
-    };
-
 private:
     typedef std::unique_ptr<Display, DisplayCloser> DisplayPointer;
 
-private:
-    // The key code that was originally mapped to the Space key (used to detect Space key presses).
-    KeyCode original_space_key_code_;
+    struct GrabbedKey {
+        KeyCode key_code;
+        bool is_press;
+    };
 
-    // The maximum amount of milliseconds during which Space can be pressed to be typed.
-    int timeout_millisec_;
+private:
+    // Makes all the tap-vs-hold decisions, calling back `now` and `tap`.
+    Engine engine_;
 
-    // The synthetic key code that will fire when Space is to be typed, see `s2sctl`.
-    KeyCode remapped_key_code_;
+    // The key codes typing the tap keysyms, by the key code of the dual-role key
+    // (a synthetic one for Space, see `s2sctl`).
+    KeyCode tap_key_codes_[256] = {};
 
-    // See Section 1.3 of the XRecord API specification which recommends to open two connections
-    // and directs which connection is typically used with each XRecord API call
-    // (presumably because of the blocking nature of `XRecordEnableContext`.
-    // A control connection to the X Server ("for recording control").
+    // A connection for the keymap queries and change notifications.
     DisplayPointer control_display_;
-    // A data connection to the X Server ("for reading recorded protocol data").
-    DisplayPointer data_display_;
-
-    XRecordContext record_context_;
-
-    // Whether Space is pressed.
-    bool space_down_ = false;
-    // If yes, indicates when the `KeyPress` event happened.
-    timeval space_down_moment_;
-
-    // Whether Space is pressed simultaneously with some other keys (so should not be typed).
-    bool space_key_combo_ = false;
+    // The first event code of XKB on it.
+    int xkb_event_base_ = 0;
+    // The keys as of the last keymap change, see `setup_key_codes`.
+    Keymap keymap_;
+    // Space acting as Super and a spare key code typing the space (and alike for the other dual-role keys),
+    // undone on exit.
+    Remapping remapping_;
+    // The dual-role keys which repeated before start.
+    std::vector<KeyCode> autorepeat_disabled_;
+
+    // Records the input events, see `record_event`.
+    std::unique_ptr<Backend> backend_;
+
+    // Whether the dual-role keys are grabbed rather than remapped: the keyboard is then grabbed from the press
+    // of one of them till its release, and its other keys re-injected (held back while undecided, like evdev does).
+    bool grabbing_;
+    // The key codes typing the hold keysyms when grabbing, by the key code of the dual-role key.
+    KeyCode hold_key_codes_[256] = {};
+    // The dual-role key whose press has activated the grab, or 0.
+    KeyCode grab_key_code_ = 0;
+    // The keys pressed by re-injection and not released yet.
+    bool injected_down_[256] = {};
+    std::vector<GrabbedKey> held_back_keys_;
+
+    // Types the taps on a connection and a thread of its own,
+    // so that recording never waits for the injection round trips.
+    Injector injector_;
+
+    // Multiplexes the backend, `signals_`, `hold_timer_` and `shutdown_timer_`.
+    EventLoop loop_;
+    // SIGINT and SIGTERM stop it, SIGUSR1 re-applies the key code mappings.
+    SignalSource signals_;
+    // Goes off when Space has been pressed for the timeout, see `Engine::commit_hold`.
+    Timer hold_timer_;
+    // Changes whenever `hold_timer_` is (re-)armed or disarmed.
+    unsigned hold_timer_generation_ = 0;
+    // Bounds the wait for the end of data on shutdown.
+    Timer shutdown_timer_;
+
+    // Turns the X server time of the recorded events into engine timestamps.
+    ServerTime server_time_;
+
+    // Left closed (and then recording nothing) unless tracing.
+    TraceWriter trace_;
 
 private:
     bool check_xtest_extension() const {
@@ -139,46 +181,56 @@ private:
         return true;
     }
 
-    bool check_xrecord_extension() const {
-        int unused;
-        if (! XRecordQueryVersion(control_display_.get(), &unused, &unused)) {
-            std::cerr <<
-                "The XRecord extension has not been loaded by the X server.\n" <<
-                "Try adding the following line:\n"
-                "     Load    \"record\"\n"
-                "into the `Module` section of /etc/X11/xorg.conf." <<
-                std::endl;
-            return false;
-        }
-        return true;
-    }
-
+    // (Re)builds `keymap_` and everything derived from it.
     bool setup_key_codes() {
-        remapped_key_code_ = XKeysymToKeycode(control_display_.get(), XK_space);
-        if (remapped_key_code_ == 0) {
-            std::cerr
-                << "Couldn't map the `XK_space` KeySym back to a key code."
-                << "You may need to run `xmodmap -e 'keycode any = space'`"
-                << "(normally `s2sctl` takes care of this)."
-                << std::endl;
+        if (! keymap_.load(control_display_.get())) {
             return false;
         }
 
         LOG("Key code mapping:");
 
-        LOG("  Space (original): " << static_cast<int>(original_space_key_code_));
-        LOG("  Space (remapped): " << static_cast<int>(remapped_key_code_));
+        KeyCode tap_key_codes[256] = {};
+        for (const DualRoleKey& key : engine_.dual_role_keys()) {
+            KeyCode tap_key_code = keymap_.key_code(key.tap);
+            // Tapping the dual-role key itself would feed back into the engine, unless it is only grabbed
+            // on the physical keyboards.
+            if (tap_key_code == 0 || (tap_key_code == key.key_code && ! grabbing_)) {
+                std::cerr
+                    << "Couldn't map the `" << key_symbol_name(key.tap) << "` KeySym to a key code "
+                    << "other than " << static_cast<int>(key.key_code) << "."
+                    << std::endl;
+                return false;
+            }
+            tap_key_codes[key.key_code] = tap_key_code;
+
+            if (grabbing_) {
+                hold_key_codes_[key.key_code] = keymap_.key_code(key.hold);
+                if (hold_key_codes_[key.key_code] == 0) {
+                    std::cerr << "Couldn't map the `" << key_symbol_name(key.hold) << "` KeySym to a key code." <<
+                        std::endl;
+                    return false;
+                }
+            }
+
+            LOG("  " << key_symbol_name(key.tap) << "/" << key_symbol_name(key.hold) << ": " <<
+                static_cast<int>(key.key_code) << " (original), " << static_cast<int>(tap_key_code) << " (tap)");
+        }
+
+        std::copy(tap_key_codes, tap_key_codes + 256, tap_key_codes_);
+
+        // So that the engine tells chords with modifiers already down apart from typing.
+        for (int key_code = 0; key_code < 256; ++key_code) {
+            engine_.set_modifier_key(
+                static_cast<KeyCode>(key_code), keymap_.key(static_cast<KeyCode>(key_code)).key_class == KEY_CLASS_MODIFIER
+            );
+        }
 
 #ifndef NDEBUG
         std::clog << "  Super_{L|R}:";
-
-        const int min_key_code = static_cast<int>(std::numeric_limits<KeyCode>::min());
-        const int max_key_code = static_cast<int>(std::numeric_limits<KeyCode>::max());
-        for (int int_key_code = min_key_code; int_key_code <= max_key_code; ++int_key_code) {
-            KeyCode key_code = static_cast<KeyCode>(int_key_code);
-            KeySym key_sym = XkbKeycodeToKeysym(control_display_.get(), key_code, /* group */ 0, /* shift */ 0);
+        for (int key_code = 0; key_code < 256; ++key_code) {
+            KeySym key_sym = keymap_.key(static_cast<KeyCode>(key_code)).key_sym;
             if (key_sym == XK_Super_L || key_sym == XK_Super_R) {
-                std::clog << ' ' << int_key_code;
+                std::clog << ' ' << key_code;
             }
         }
         std::clog << std::endl;
@@ -187,6 +239,73 @@ private:
         return true;
     }
 
+    // (Re-)applies `remapping_` and resolves the key codes on top of it.
+    bool remap_keys() {
+        if (! grabbing_ &&
+            (! keymap_.load(control_display_.get()) ||
+             ! remapping_.apply(control_display_.get(), keymap_, engine_.dual_role_keys())))
+        {
+            return false;
+        }
+        return setup_key_codes();
+    }
+
+    // Held, the dual-role keys would only repeat presses for the engine to ignore (some 30 a second),
+    // waking the daemon up for nothing, so their autorepeat is turned off while it runs.
+    void disable_autorepeat() {
+        XKeyboardState state;
+        XGetKeyboardControl(control_display_.get(), &state);
+        for (const DualRoleKey& key : engine_.dual_role_keys()) {
+            if (! (state.auto_repeats[key.key_code >> 3] & (1 << (key.key_code & 7)))) {
+                continue;
+            }
+            XKeyboardControl control;
+            control.key = key.key_code;
+            control.auto_repeat_mode = AutoRepeatModeOff;
+            XChangeKeyboardControl(control_display_.get(), KBKey | KBAutoRepeatMode, &control);
+            autorepeat_disabled_.push_back(key.key_code);
+        }
+    }
+
+    // Undoes `remapping_` and `disable_autorepeat`.
+    void restore_keyboard() {
+        for (KeyCode key_code : autorepeat_disabled_) {
+            XKeyboardControl control;
+            control.key = key_code;
+            control.auto_repeat_mode = AutoRepeatModeOn;
+            XChangeKeyboardControl(control_display_.get(), KBKey | KBAutoRepeatMode, &control);
+        }
+        autorepeat_disabled_.clear();
+        remapping_.restore(control_display_.get());
+        // The connection may be closed right after.
+        XSync(control_display_.get(), /* discard */ False);
+    }
+
+    bool grab_keys() {
+        std::vector<KeyCode> key_codes;
+        for (const DualRoleKey& key : engine_.dual_role_keys()) {
+            key_codes.push_back(key.key_code);
+        }
+        if (! backend_->grab_keys(key_codes)) {
+            std::cerr << "Could not grab the dual-role keys (only the `grab` backend can)." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Has the X server report keymap changes on the control connection, see `process_control_replies`.
+    bool watch_keymap() {
+        int opcode, error_base, major = XkbMajorVersion, minor = XkbMinorVersion;
+        if (! XkbQueryExtension(control_display_.get(), &opcode, &xkb_event_base_, &error_base, &major, &minor)) {
+            std::cerr << "The XKB extension is not available." << std::endl;
+            return false;
+        }
+        // (Core `MappingNotify` events come unsolicited.)
+        const unsigned EVENTS = XkbMapNotifyMask | XkbNewKeyboardNotifyMask;
+        XkbSelectEvents(control_display_.get(), XkbUseCoreKbd, EVENTS, EVENTS);
+        return true;
+    }
+
     bool open_display(DisplayPointer& display) {
         display.reset(XOpenDisplay(/* display_name */ nullptr));  // $DISPLAY by default.
         if (display == nullptr) {
@@ -199,18 +318,29 @@ private:
     bool initialize() {
         LOG("Initializing Space2Super...");
 
-        if (! open_display(control_display_) ||
-            ! open_display(data_display_) ||
-            ! check_xtest_extension() ||
-            ! check_xrecord_extension())
+        // Before the keymap changes, which only a handled signal undoes, and before the injection thread starts,
+        // which would otherwise leave the signals unblocked (and fatal) in it.
+        if (! signals_.open({SIGINT, SIGTERM, SIGUSR1}) ||
+            ! open_display(control_display_) ||
+            ! check_xtest_extension())
         {
             return false;
         }
 
-        // Requires Xlib to report errors as they occur.
-        XSynchronize(control_display_.get(), True);
+        XSetErrorHandler(report_x_error);
 
-        if (! setup_key_codes()) {
+        if (! watch_keymap() || ! remap_keys()) {
+            restore_keyboard();
+            return false;
+        }
+        disable_autorepeat();
+
+        if (! injector_.start() ||
+            ! loop_.open() ||
+            ! hold_timer_.open() ||
+            ! shutdown_timer_.open())
+        {
+            restore_keyboard();
             return false;
         }
 
@@ -221,35 +351,24 @@ private:
     bool start_loop() {
         LOG("Starting Space2Super event loop...");
 
-        XRecordClientSpec record_client_spec = XRecordAllClients;
-        XRecordClientSpec record_client_specs[] = {record_client_spec};
-
-        std::unique_ptr<XRecordRange, XObjectDestructor> record_range{XRecordAllocRange()};
-        if (record_range == nullptr) {
-            std::cerr << "Could not allocate a record range object (XRecordRange)." << std::endl;
+        if (! backend_->start(*this) || (grabbing_ && ! grab_keys())) {
             return false;
         }
-        record_range->device_events.first = KeyPress;
-        record_range->device_events.last = ButtonRelease;
-        XRecordRange* record_ranges[] = {record_range.get()};
 
-        record_context_ = XRecordCreateContext(
-            control_display_.get(), /* datum_flags */ 0 /* disable all options */,
-            record_client_specs, /* nclients */ std::extent<decltype(record_client_specs)>::value,
-            record_ranges, /* n_ranges */ std::extent<decltype(record_ranges)>::value
-        );
-
-        if (record_context_ == 0) {
-            std::cerr << "Could not create a record context (XRecordContext)." << std::endl;
+        if (! loop_.watch(backend_->fd(), [this]() { process_replies(); }) ||
+            ! loop_.watch(ConnectionNumber(control_display_.get()), [this]() { process_control_replies(); }) ||
+            ! loop_.watch(signals_.fd(), [this]() { handle_signals(); }) ||
+            ! loop_.watch(hold_timer_.fd(), [this]() { handle_hold_timeout(); }) ||
+            ! loop_.watch(shutdown_timer_.fd(), [this]() { handle_shutdown_timeout(); }))
+        {
             return false;
         }
 
-        // The application will wait for this synchronous call until `stop` is invoked.
-        auto status = XRecordEnableContext(
-            data_display_.get(), record_context_, event_callback, reinterpret_cast<XPointer>(this)
-        );
-        if (status == 0) {
-            std::cerr << "Couldn't enable the record context." << std::endl;
+        // Replies might have been read into the client-side queue while starting.
+        process_replies();
+
+        // Will loop until `finish` is invoked.
+        if (! loop_.run()) {
             return false;
         }
 
@@ -257,171 +376,278 @@ private:
         return true;
     }
 
-    static int timespan_milliseconds(const timeval& start, const timeval& end) {
-        return
-            (end.tv_sec - start.tv_sec) * 1000 +
-            (end.tv_usec - start.tv_usec) / 1000;
+    void process_replies() {
+        backend_->process();
     }
 
-    static const char* yes_or_no(bool value) {
-        return value ? "yes" : "no";
-    };
-
-    bool space_down_alone() const {
-        return space_down_ && ! space_key_combo_;
+    // Keymap changes (a burst of them for one `xmodmap` run) are handled once the pending events are read;
+    // reading errors invokes `report_x_error`.
+    void process_control_replies() {
+        bool keymap_changed = false;
+        while (XPending(control_display_.get()) > 0) {
+            XEvent event;
+            XNextEvent(control_display_.get(), &event);
+            if (event.type == MappingNotify) {
+                XRefreshKeyboardMapping(&event.xmapping);
+                keymap_changed = keymap_changed || event.xmapping.request != MappingPointer;
+            } else if (event.type == xkb_event_base_) {
+                int xkb_type = reinterpret_cast<XkbEvent&>(event).any.xkb_type;
+                keymap_changed = keymap_changed || xkb_type == XkbMapNotify || xkb_type == XkbNewKeyboardNotify;
+            }
+        }
+        if (keymap_changed) {
+            LOG("Keymap changed.");
+            // Our own changes come back as another (then uneventful) notification.
+            if (! remap_keys()) {
+                std::cerr << "Keeping the previous key codes after a keymap change." << std::endl;
+            }
+        }
     }
 
-    void log_state(const char* description) const {
-        (void)description;  // Prevent flagging as unused on NDEBUG.
-        LOG(description << ":" <<
-            "  Space down: " << yes_or_no(space_down_) <<
-            "  Key combination: " << yes_or_no(space_key_combo_) <<
-            "  Space alone: " << yes_or_no(space_down_alone())
-        );
-    }
+    void handle_hold_timeout() {
+        if (! hold_timer_.acknowledge()) {
+            return;
+        }
 
-    bool is_space(KeyCode key_code) const {
-        if (key_code == original_space_key_code_) {
-            LOG("  Space");
-            return true;
+        // A release that is already queued on the data connection must win over the timer.
+        unsigned generation = hold_timer_generation_;
+        process_replies();
+        if (generation == hold_timer_generation_) {
+            engine_.commit_hold();
         }
-        return false;
     }
 
-    void simulate_typed_space() {
-        LOG("  Simulating key press, key code " << static_cast<int>(remapped_key_code_));
-        XTestFakeKeyEvent(control_display_.get(), remapped_key_code_, True, CurrentTime);
-        XTestFakeKeyEvent(control_display_.get(), remapped_key_code_, False, CurrentTime);
+    void handle_signals() {
+        while (int signal_number = signals_.read_signal()) {
+            LOG("Received signal " << signal_number << ".");
+            if (signal_number == SIGUSR1) {
+                // From `s2sctl remap`.
+                if (! remap_keys()) {
+                    std::cerr << "Could not re-apply the key code mappings." << std::endl;
+                }
+            } else {
+                request_stop();
+            }
+        }
     }
 
-    void handle_key_press(KeyCode key_code) {
-        LOG("KeyPress");
+    // Asks the backend to stop recording; the loop finishes once it confirms with the end of data.
+    void request_stop() {
+        LOG("Stopping Space2Super event loop...");
+        if (! backend_->request_stop()) {
+            finish();
+            return;
+        }
+        shutdown_timer_.arm(SHUTDOWN_TIMEOUT_MICROSEC);
+    }
 
-        if (is_space(key_code)) {
-            space_down_ = true;
-            gettimeofday(&space_down_moment_, nullptr);
-        } else {
-            LOG("  Other: "
-                << XKeysymToString(XkbKeycodeToKeysym(control_display_.get(), key_code, /* group */ 0, /* shift */ 0))
-            );
-            space_key_combo_ = space_down_;
+    void handle_shutdown_timeout() {
+        if (shutdown_timer_.acknowledge()) {
+            std::cerr << "The end of recorded data did not arrive in time." << std::endl;
+            finish();
         }
     }
 
-    void handle_key_release(KeyCode key_code) {
-        LOG("KeyRelease");
+    void finish() {
+        shutdown_timer_.disarm();
+        loop_.stop();
+    }
 
-        if (is_space(key_code)) {
-            if (space_down_alone()) {
-                struct timeval space_release_moment;
-                gettimeofday(&space_release_moment, nullptr);
-                int space_held_milliseconds = timespan_milliseconds(space_down_moment_, space_release_moment);
-                LOG("  Released alone; " << space_held_milliseconds <<
-                    " ms passed since it was pressed, the limit is " << timeout_millisec_ << " ms");
+    // Only consulted for events that come without the X server time.
+    Timestamp now() override {
+        timespec moment;
+        clock_gettime(CLOCK_MONOTONIC, &moment);
+        return static_cast<Timestamp>(moment.tv_sec) * 1000000 + moment.tv_nsec / 1000;
+    }
 
-                // If a minimum timeout has elapsed since space was pressed...
-                if (space_held_milliseconds <= timeout_millisec_) {
-                    simulate_typed_space();
-                }
-            }
+    // Hands both fake events over to the injection thread, which sends them in a single write.
+    void tap(const DualRoleKey& key) override {
+        trace_.record_decision(TRACE_TAP, key.key_code);
+        KeyCode tap_key_code = tap_key_codes_[key.key_code];
+        LOG("  Simulating key press, key code " << static_cast<int>(tap_key_code));
+        if (! injector_.tap(tap_key_code)) {
+            std::cerr << "The injection queue is full, dropping a tap." << std::endl;
+        }
+        release_held_back_keys();
+    }
 
-            space_down_ = false;
-            space_key_combo_ = false;
+    void hold(const DualRoleKey& key) override {
+        LOG("  Key code " << static_cast<int>(key.key_code) << " committed to be held");
+        trace_.record_decision(TRACE_HOLD, key.key_code);
+        if (! grabbing_) {
+            // The key is already mapped to its hold keysym, so clients see the press without extra events.
+            return;
         }
+        inject(hold_key_codes_[key.key_code], true);
+        release_held_back_keys();
     }
 
-    void handle_button_press() {
-        LOG("ButtonPress");
-        space_key_combo_ = space_down_;
+    void release_hold(const DualRoleKey& key) override {
+        trace_.record_decision(TRACE_RELEASE_HOLD, key.key_code);
+        if (grabbing_) {
+            inject(hold_key_codes_[key.key_code], false);
+        }
     }
 
-    void process_event(KeyCode event_type, KeyCode key_code) {
-        switch (event_type) {
-        case KeyPress:
-        case KeyRelease:
-        case ButtonPress:
-            LOG("");  // Separate event reports with blank lines.
-            log_state("State before");
-            break;
-        default:
-            return;
+    void inject(KeyCode key_code, bool is_press) {
+        if (! injector_.send(key_code, is_press)) {
+            std::cerr << "The injection queue is full, dropping a key event." << std::endl;
         }
+    }
 
-        switch (event_type) {
-        case KeyPress:
-            handle_key_press(key_code);
-            break;
-        case KeyRelease:
-            handle_key_release(key_code);
-            break;
-        case ButtonPress:
-            handle_button_press();
-            break;
+    // Re-injects a key of the grabbed keyboard, after the undecided dual-role key is decided upon
+    // if it is holding keys back.
+    void pass_grabbed(KeyCode key_code, bool is_press) {
+        injected_down_[key_code] = is_press;
+        if (engine_.holding_back() || ! held_back_keys_.empty()) {
+            held_back_keys_.push_back({key_code, is_press});
+        } else {
+            inject(key_code, is_press);
         }
+    }
 
-        LOG("  Key code: " << static_cast<int>(key_code));
+    void release_held_back_keys() {
+        for (const GrabbedKey& key : held_back_keys_) {
+            inject(key.key_code, key.is_press);
+        }
+        held_back_keys_.clear();
+    }
 
-        log_state("State after ");  // An additional space to align with "before".
+    void schedule_hold(Timestamp microseconds) override {
+        ++hold_timer_generation_;
+        hold_timer_.arm(microseconds);
     }
 
-    // Called from the X server when a new event occurs.
-    static void event_callback(
-        XPointer callback_closure, XRecordInterceptData* intercept_data)
-    {
-        std::unique_ptr<XRecordInterceptData, XRecordInterceptDataDestructor> data{intercept_data};
+    void cancel_hold() override {
+        ++hold_timer_generation_;
+        hold_timer_.disarm();
+    }
 
-        if (data->category != XRecordFromServer) {
-            return;
+    void log_key(int event_type, KeyCode key_code) const {
+        (void)event_type;  // Prevent flagging as unused on NDEBUG.
+        (void)key_code;
+#ifndef NDEBUG
+        if (event_type == KeyPress && engine_.dual_role_key(key_code) == nullptr) {
+            LOG("  Other: " << keymap_.key(key_code).name);
         }
+#endif
+    }
 
-        const xEvent& event = *reinterpret_cast<xEvent*>(intercept_data->data);
-        const auto& generic_event = event.u.u;
-        KeyCode event_type = generic_event.type;
-        KeyCode key_code = generic_event.detail;
+    void record_event(int event_type, KeyCode key_code, std::uint32_t server_millisec) override {
+        // The moment the server saw the event, unaffected by how late it is processed.
+        Timestamp time = server_millisec != CurrentTime ? server_time_.extend(server_millisec) : NO_TIME;
 
-        auto self = reinterpret_cast<Space2Super*>(callback_closure);
-        self->process_event(event_type, key_code);
-    }
+        log_key(event_type, key_code);
+        // Before the decisions it may lead to.
+        trace_.record_event(event_type, key_code, time);
+        engine_.process_event(event_type, key_code, time);
 
-    void stop() {
-        LOG("Stopping Space2Super event loop...");
-        if (! XRecordDisableContext (control_display_.get(), record_context_)) {
-            std::cerr << "Couldn't disable the record context." << std::endl;
+        // A key re-injected during a grab and released after it: the XTest keyboard has to let go of it too.
+        if (grabbing_ && grab_key_code_ == 0 && event_type == KeyRelease && injected_down_[key_code]) {
+            injected_down_[key_code] = false;
+            inject(key_code, false);
         }
-        XRecordFreeContext(control_display_.get(), record_context_);
     }
-};
 
-std::unique_ptr<Space2Super> instance;
+    // Follows `record_event` for the same key, which has already let the engine decide.
+    void grabbed_event(int event_type, KeyCode key_code, bool repeat) override {
+        if (engine_.dual_role_key(key_code) != nullptr) {
+            // The grab lasts from the press of the key that has activated it till its release.
+            if (event_type == KeyPress && grab_key_code_ == 0) {
+                grab_key_code_ = key_code;
+            } else if (event_type == KeyRelease && key_code == grab_key_code_) {
+                grab_key_code_ = 0;
+            }
+            return;
+        }
+        if (repeat) {
+            // The server repeats the re-injected key by itself.
+            return;
+        }
+        if (event_type == KeyRelease && ! injected_down_[key_code]) {
+            // Pressed before the grab. The master keyboard only learns about the release through XTest,
+            // which needs a press first; that only matters (and does no harm) for modifiers.
+            if (keymap_.key(key_code).key_class != KEY_CLASS_MODIFIER) {
+                return;
+            }
+            pass_grabbed(key_code, true);
+        }
+        pass_grabbed(key_code, event_type == KeyPress);
+    }
 
-void stop(int signal_number) {
-    LOG("Received signal " << signal_number << ".");
-    if (signal_number == SIGINT || signal_number == SIGTERM) {
-        LOG("Destroying Space2Super.");
-        instance.reset();
-        LOG("Exiting.");
-        exit(EXIT_SUCCESS);
-    } else {
-        throw std::logic_error("Should not receive signals other than SIGINT and SIGTERM");
+    void end_of_data() override {
+        finish();
     }
+};
+
+int usage(const char* program) {
+    std::cerr << "Usage: " << program <<
+        " KEYCODE TIMEOUT [BACKEND|evdev DEVICE] [ENGINE OPTIONS] [--trace=PATH]" << std::endl;
+    std::cerr << "Use `" << DRIVER << "` to start/stop Space2Super" << std::endl;
+    return EXIT_FAILURE;
 }
 
 int main(const int argc, const char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Use `" << DRIVER << "` to start/stop Space2Super" << std::endl;
-        return EXIT_FAILURE;
+    std::vector<const char*> arguments;
+    EngineOptions options;
+    // Set by `--trace=PATH`.
+    std::string trace_path;
+    for (int index = 1; index < argc; ++index) {
+        if (std::strncmp(argv[index], "--", 2) != 0) {
+            arguments.push_back(argv[index]);
+        } else if (std::strncmp(argv[index], "--trace=", 8) == 0) {
+            trace_path = argv[index] + 8;
+        } else if (! parse_engine_option(argv[index], options)) {
+            return EXIT_FAILURE;
+        }
     }
 
-    KeyCode original_space_key_code = static_cast<KeyCode>(atoi(argv[1]));
-    int timeout = atoi(argv[2]);
+    // X key codes range from 8 to 255, for the evdev backend too.
+    int key_code = 0;
+    int timeout = 0;
+    if (arguments.size() < 2 || arguments.size() > 4 ||
+        ! parse_count(arguments[0], key_code) || key_code < 8 || key_code > 0xff ||
+        ! parse_count(arguments[1], timeout) || timeout == 0)
+    {
+        return usage(argv[0]);
+    }
+    KeyCode original_space_key_code = static_cast<KeyCode>(key_code);
+    std::string backend_name = arguments.size() >= 3 ? arguments[2] : BACKEND_NAMES[0];
 
+    // SIGINT, SIGTERM (and SIGUSR1 in the X adapter) are handled in the event loop.
     signal(SIGHUP, SIG_IGN);
-    signal(SIGINT, stop);
-    signal(SIGTERM, stop);
+
+    if (backend_name == "evdev") {
+        if (arguments.size() != 4) {
+            std::cerr << "The evdev backend needs an input device path." << std::endl;
+            return EXIT_FAILURE;
+        }
+        try {
+            EvdevDaemon daemon(arguments[3], original_space_key_code, timeout, options, trace_path);
+            // Will loop until SIGINT or SIGTERM.
+            daemon.run();
+        } catch (const EvdevDaemon::InitializationError&) {
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    std::unique_ptr<Backend> backend = make_backend(backend_name);
+    if (backend == nullptr) {
+        return EXIT_FAILURE;
+    }
+
+    // The injection thread has an X connection of its own, but Xlib still shares some state.
+    if (! XInitThreads()) {
+        std::cerr << "Could not initialize Xlib thread support." << std::endl;
+        return EXIT_FAILURE;
+    }
 
     try {
-        Space2Super space2super(original_space_key_code, timeout);
-        // Will loop until the destructor is called from `stop`.
+        Space2Super space2super(
+            original_space_key_code, timeout, options, std::move(backend), backend_name == "grab", trace_path
+        );
+        // Will loop until SIGINT or SIGTERM.
         space2super.run();
     } catch (const Space2Super::InitializationError&) {
         return EXIT_FAILURE;
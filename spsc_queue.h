@@ -0,0 +1,45 @@
+#ifndef SPACE2SUPER_SPSC_QUEUE_H
+#define SPACE2SUPER_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+
+// A bounded lock-free queue for exactly one producer thread and one consumer thread.
+// `CAPACITY` must be a power of two.
+template <typename T, std::size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+    // Producer only; returns false if the queue is full.
+    bool push(const T& item) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        items_[tail & (CAPACITY - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only; returns false if the queue is empty.
+    bool pop(T& item) {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items_[head & (CAPACITY - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Kept on separate cache lines so that the two threads do not contend for them.
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) T items_[CAPACITY];
+};
+
+
+#endif  // SPACE2SUPER_SPSC_QUEUE_H
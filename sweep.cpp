@@ -0,0 +1,268 @@
+/*
+    Replays recorded event traces (see `trace.h`) under a grid of timeouts and tap-hold strategies,
+    spread over all cores, and reports for each point:
+    * lost spaces: the share of Space presses meant as spaces which were not typed;
+    * unintended spaces: the share of Space presses meant as Super which were typed as spaces;
+    * the mean time from the press of Space to the decision upon it.
+    What was meant is told from the trace itself: a key or button both pressed and released while Space
+    is down, or pressed during it and still down for longer than `SLOPPY_CHORD_MILLISEC` after it is released,
+    means Super; anything else (including a key rolling over from Space in fast typing) means a space.
+
+    Build with:
+        make space2super-sweep
+    and run as:
+        ./space2super-sweep [--timeouts=MILLISECONDS,...] [--strategies=NAME,...] KEYCODE TRACE... [ENGINE OPTIONS]
+    where KEYCODE is that of Space, the strategies are named as for `--strategy` (all of them by default)
+    and the other engine options (see `options.h`) apply to every point.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "options.h"
+#include "trace.h"
+#include "trace_replay.h"
+
+
+namespace {
+
+const char* const DEFAULT_TIMEOUTS = "150,200,250,300,350,400,500,600,800,1000";
+const char* const STRATEGY_NAMES[] = {"hold-on-other-key-press", "permissive-hold", "tap-preferred"};
+
+// A key still down that long after Space is released was pressed as part of a chord, not typed after a space.
+const Timestamp SLOPPY_CHORD_MILLISEC = 150;
+
+struct Trace {
+    std::vector<TraceRecord> events;
+    // Whether each press of Space (autorepeat aside) was meant as a space.
+    std::vector<bool> meant_spaces;
+};
+
+struct Point {
+    int timeout_millisec;
+    std::string strategy;
+
+    // The results.
+    long spaces_meant = 0;
+    long spaces_lost = 0;
+    long chords_meant = 0;
+    long unintended_spaces = 0;
+    long decisions = 0;
+    Timestamp total_latency_microsec = 0;
+};
+
+std::vector<std::string> split(const char* list) {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// Labels the Space presses of `trace.events`, see the top comment.
+void label_presses(Trace& trace, KeyCode space_key_code) {
+    // When each key was last pressed, and buttons (offset by 256) alike.
+    std::vector<Timestamp> pressed_at(512, NO_TIME);
+    // The last press of Space and its release (`NO_TIME` while down).
+    long space_press = -1;
+    Timestamp space_pressed_at = NO_TIME;
+    Timestamp space_released_at = NO_TIME;
+
+    Timestamp time = 0;
+    for (const TraceRecord& event : trace.events) {
+        time = event.time != NO_TIME ? event.time : time;
+        bool is_button = event.kind == BUTTON_PRESS || event.kind == BUTTON_RELEASE;
+        int index = event.key_code + (is_button ? 256 : 0);
+
+        if (! is_button && event.key_code == space_key_code) {
+            if (event.kind == KEY_PRESS && (space_press < 0 || space_released_at != NO_TIME)) {
+                trace.meant_spaces.push_back(true);
+                space_press = static_cast<long>(trace.meant_spaces.size()) - 1;
+                space_pressed_at = time;
+                space_released_at = NO_TIME;
+            } else if (event.kind == KEY_RELEASE) {
+                space_released_at = time;
+            }
+            continue;
+        }
+
+        if (event.kind == KEY_PRESS || event.kind == BUTTON_PRESS) {
+            if (pressed_at[index] == NO_TIME) {
+                pressed_at[index] = time;
+            }
+            continue;
+        }
+        Timestamp pressed = pressed_at[index];
+        pressed_at[index] = NO_TIME;
+        if (space_press < 0 || pressed == NO_TIME || pressed < space_pressed_at) {
+            continue;
+        }
+        if (space_released_at == NO_TIME ||
+            (pressed < space_released_at && time - space_released_at > SLOPPY_CHORD_MILLISEC * 1000))
+        {
+            trace.meant_spaces[space_press] = false;
+        }
+    }
+}
+
+bool is_space_decision(const TraceRecord& decision, KeyCode space_key_code) {
+    return decision.key_code == space_key_code && (decision.kind == TRACE_TAP || decision.kind == TRACE_HOLD);
+}
+
+void evaluate(Point& point, const std::vector<Trace>& traces, KeyCode space_key_code, EngineOptions options) {
+    parse_engine_option(("--strategy=" + point.strategy).c_str(), options);
+
+    for (const Trace& trace : traces) {
+        TraceReplay replay(space_key_code, point.timeout_millisec, options);
+        // The press times of Space, to match with the decisions in order.
+        std::vector<Timestamp> presses;
+        bool space_down = false;
+        Timestamp last_time = 0;
+        for (const TraceRecord& event : trace.events) {
+            last_time = event.time != NO_TIME ? event.time : last_time;
+            if (event.kind == KEY_PRESS && event.key_code == space_key_code && ! space_down) {
+                presses.push_back(last_time);
+            }
+            if (event.key_code == space_key_code && (event.kind == KEY_PRESS || event.kind == KEY_RELEASE)) {
+                space_down = event.kind == KEY_PRESS;
+            }
+            replay.set_now(last_time);
+            replay.feed(event);
+        }
+        replay.commit_hold();
+
+        std::size_t press = 0;
+        for (const TraceRecord& decision : replay.decisions()) {
+            if (! is_space_decision(decision, space_key_code) || press >= presses.size()) {
+                continue;
+            }
+            bool tapped = decision.kind == TRACE_TAP;
+            if (trace.meant_spaces[press]) {
+                ++point.spaces_meant;
+                point.spaces_lost += ! tapped;
+            } else {
+                ++point.chords_meant;
+                point.unintended_spaces += tapped;
+            }
+            ++point.decisions;
+            point.total_latency_microsec += decision.time - presses[press];
+            ++press;
+        }
+    }
+}
+
+int usage(const char* program) {
+    std::cerr << "Usage: " << program <<
+        " [--timeouts=MILLISECONDS,...] [--strategies=NAME,...] KEYCODE TRACE... [ENGINE OPTIONS]" << std::endl;
+    return EXIT_FAILURE;
+}
+
+double percentage(long part, long whole) {
+    return whole > 0 ? 100.0 * part / whole : 0.0;
+}
+
+}  // namespace
+
+
+int main(const int argc, const char* argv[]) {
+    std::vector<const char*> arguments;
+    EngineOptions options;
+    std::vector<std::string> timeouts = split(DEFAULT_TIMEOUTS);
+    std::vector<std::string> strategies(STRATEGY_NAMES, STRATEGY_NAMES + 3);
+    for (int index = 1; index < argc; ++index) {
+        if (std::strncmp(argv[index], "--", 2) != 0) {
+            arguments.push_back(argv[index]);
+        } else if (std::strncmp(argv[index], "--timeouts=", 11) == 0) {
+            timeouts = split(argv[index] + 11);
+        } else if (std::strncmp(argv[index], "--strategies=", 13) == 0) {
+            strategies = split(argv[index] + 13);
+        } else if (! parse_engine_option(argv[index], options)) {
+            return EXIT_FAILURE;
+        }
+    }
+    int key_code = 0;
+    if (arguments.size() < 2 || ! parse_count(arguments[0], key_code) || key_code == 0 || key_code > 0xff) {
+        return usage(argv[0]);
+    }
+    KeyCode space_key_code = static_cast<KeyCode>(key_code);
+
+    if (timeouts.empty() || strategies.empty()) {
+        return usage(argv[0]);
+    }
+
+    std::vector<Point> points;
+    for (const std::string& strategy : strategies) {
+        EngineOptions checked;
+        if (! parse_engine_option(("--strategy=" + strategy).c_str(), checked)) {
+            return EXIT_FAILURE;
+        }
+        for (const std::string& timeout : timeouts) {
+            Point point;
+            if (! parse_count(timeout.c_str(), point.timeout_millisec) || point.timeout_millisec == 0) {
+                std::cerr << "Invalid timeout: `" << timeout << "`" << std::endl;
+                return usage(argv[0]);
+            }
+            point.strategy = strategy;
+            points.push_back(point);
+        }
+    }
+
+    std::vector<Trace> traces;
+    long presses = 0;
+    for (std::size_t index = 1; index < arguments.size(); ++index) {
+        Trace trace;
+        std::vector<TraceRecord> records;
+        if (! read_trace(arguments[index], records)) {
+            return EXIT_FAILURE;
+        }
+        // The recorded decisions are only in the way.
+        for (const TraceRecord& record : records) {
+            if (record.kind >= KEY_PRESS && record.kind <= BUTTON_RELEASE) {
+                trace.events.push_back(record);
+            }
+        }
+        label_presses(trace, space_key_code);
+        presses += static_cast<long>(trace.meant_spaces.size());
+        traces.push_back(std::move(trace));
+    }
+
+    // The points are handed out one at a time, since they take very different times.
+    std::atomic<std::size_t> next_point(0);
+    auto work = [&]() {
+        for (std::size_t index; (index = next_point.fetch_add(1)) < points.size(); ) {
+            evaluate(points[index], traces, space_key_code, options);
+        }
+    };
+    std::vector<std::thread> workers;
+    unsigned thread_count = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), points.size()));
+    for (unsigned thread = 0; thread < thread_count; ++thread) {
+        workers.emplace_back(work);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    std::cout << presses << " presses of Space in " << traces.size() << " trace(s), " << thread_count <<
+        " threads" << std::endl;
+    std::cout << "timeout  strategy                 lost spaces  unintended spaces  mean latency" << std::endl;
+    std::cout << std::fixed;
+    for (const Point& point : points) {
+        std::cout << std::setw(5) << point.timeout_millisec << " ms  " << std::left << std::setw(25) << point.strategy <<
+            std::right << std::setprecision(2) << std::setw(9) << percentage(point.spaces_lost, point.spaces_meant) <<
+            " %  " << std::setw(15) << percentage(point.unintended_spaces, point.chords_meant) << " %  " <<
+            std::setprecision(1) << std::setw(9) <<
+            (point.decisions > 0 ? point.total_latency_microsec / 1000.0 / point.decisions : 0.0) << " ms" << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace {
+
+const char MAGIC[8] = {'S', '2', 'S', 'T', 'R', 'A', 'C', 'E'};
+const std::uint32_t VERSION = 1;
+const std::uint32_t BLOCK_SIZE = 4096;
+
+// Native byte order: traces are read back on the machine that has recorded them.
+struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t block_size;
+    std::uint32_t block_count;
+    std::uint32_t reserved;
+};
+
+struct BlockHeader {
+    // Of the blocks in the order they were started; 0 for unused ones.
+    std::uint64_t sequence;
+    Timestamp base_time;
+    // The bytes of records after the header.
+    std::uint32_t used;
+    std::uint32_t reserved;
+};
+
+const std::uint32_t BLOCK_CAPACITY = BLOCK_SIZE - sizeof(BlockHeader);
+
+// The kind and the key code bytes, and a 64-bit varint.
+const std::uint32_t MAX_RECORD_SIZE = 2 + 10;
+
+// Marks records without a time (and then without a delta).
+const unsigned char UNTIMED = 0x80;
+
+}  // namespace
+
+
+TraceWriter::~TraceWriter() {
+    if (map_ != nullptr) {
+        munmap(map_, map_size_);
+    }
+}
+
+bool TraceWriter::open(const std::string& path, std::size_t capacity) {
+    block_count_ = static_cast<std::uint32_t>(std::max<std::size_t>(2, (capacity + BLOCK_CAPACITY - 1) / BLOCK_CAPACITY));
+    map_size_ = sizeof(FileHeader) + static_cast<std::size_t>(block_count_) * BLOCK_SIZE;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Could not create the trace file " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    bool sized = ftruncate(fd, static_cast<off_t>(map_size_)) == 0;
+    void* map = sized ? mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Could not map the trace file " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    map_ = static_cast<unsigned char*>(map);
+
+    FileHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.block_size = BLOCK_SIZE;
+    header.block_count = block_count_;
+    std::memcpy(map_, &header, sizeof(header));
+
+    // The first record starts the first block.
+    block_ = block_count_ - 1;
+    used_ = BLOCK_CAPACITY;
+    return true;
+}
+
+void TraceWriter::start_block(Timestamp time) {
+    block_ = block_ + 1 < block_count_ ? block_ + 1 : 0;
+    used_ = 0;
+    block_time_ = time;
+
+    BlockHeader header = {};
+    header.sequence = ++sequence_;
+    header.base_time = time;
+    std::memcpy(map_ + sizeof(FileHeader) + static_cast<std::size_t>(block_) * BLOCK_SIZE, &header, sizeof(header));
+}
+
+void TraceWriter::record(int kind, KeyCode key_code, Timestamp time) {
+    if (map_ == nullptr) {
+        return;
+    }
+    if (used_ + MAX_RECORD_SIZE > BLOCK_CAPACITY) {
+        start_block(time != NO_TIME ? time : last_time_);
+    }
+
+    unsigned char* block = map_ + sizeof(FileHeader) + static_cast<std::size_t>(block_) * BLOCK_SIZE;
+    unsigned char* out = block + sizeof(BlockHeader) + used_;
+    *out++ = static_cast<unsigned char>(kind) | (time == NO_TIME ? UNTIMED : 0);
+    *out++ = key_code;
+    if (time != NO_TIME) {
+        std::int64_t delta = static_cast<std::int64_t>(time - block_time_);
+        std::uint64_t zigzag = (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63);
+        while (zigzag >= 0x80) {
+            *out++ = static_cast<unsigned char>(zigzag) | 0x80;
+            zigzag >>= 7;
+        }
+        *out++ = static_cast<unsigned char>(zigzag);
+        block_time_ = time;
+        last_time_ = time;
+    }
+
+    // Publish the record only once it is complete, in case the process dies meanwhile.
+    used_ = static_cast<std::uint32_t>(out - (block + sizeof(BlockHeader)));
+    std::memcpy(block + offsetof(BlockHeader, used), &used_, sizeof(used_));
+}
+
+bool read_trace(const std::string& path, std::vector<TraceRecord>& records) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    FileHeader header;
+    if (data.size() < sizeof(header) ||
+        (std::memcpy(&header, data.data(), sizeof(header)), std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) ||
+        header.version != VERSION || header.block_size != BLOCK_SIZE ||
+        data.size() < sizeof(header) + static_cast<std::size_t>(header.block_count) * BLOCK_SIZE)
+    {
+        std::cerr << "Not a Space2Super trace file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<std::uint64_t, const unsigned char*>> blocks;
+    for (std::uint32_t index = 0; index < header.block_count; ++index) {
+        const unsigned char* block = data.data() + sizeof(header) + static_cast<std::size_t>(index) * BLOCK_SIZE;
+        BlockHeader block_header;
+        std::memcpy(&block_header, block, sizeof(block_header));
+        if (block_header.sequence != 0) {
+            blocks.push_back({block_header.sequence, block});
+        }
+    }
+    std::sort(blocks.begin(), blocks.end());
+
+    for (const auto& entry : blocks) {
+        BlockHeader block_header;
+        std::memcpy(&block_header, entry.second, sizeof(block_header));
+        const unsigned char* in = entry.second + sizeof(BlockHeader);
+        const unsigned char* end = in + std::min(block_header.used, BLOCK_CAPACITY);
+        Timestamp time = block_header.base_time;
+        while (end - in >= 2) {
+            TraceRecord record;
+            record.kind = *in & ~UNTIMED;
+            bool untimed = (*in++ & UNTIMED) != 0;
+            record.key_code = *in++;
+            record.time = NO_TIME;
+            if (! untimed) {
+                std::uint64_t zigzag = 0;
+                for (int shift = 0; in < end && shift < 64; shift += 7) {
+                    unsigned char byte = *in++;
+                    zigzag |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                    if (! (byte & 0x80)) {
+                        break;
+                    }
+                }
+                time += static_cast<Timestamp>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+                record.time = time;
+            }
+            records.push_back(record);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef SPACE2SUPER_TRACE_H
+#define SPACE2SUPER_TRACE_H
+
+/*
+    Event traces: what a daemon has fed the engine (and what the engine has decided),
+    recorded into a memory-mapped ring file cheaply enough to stay on in production,
+    and read back for offline replays.
+
+    The file is a header followed by fixed-size blocks used as a ring. Each block starts with
+    a sequence number and a base time, and holds records of a kind byte, a key code byte
+    and the time as a zigzag varint delta from the previous record in the block,
+    so that a block is readable on its own once the ones before it have been overwritten.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+
+// The input events keep their `EventType` values.
+enum TraceRecordKind {
+    TRACE_TAP = 16,
+    TRACE_HOLD = 17,
+    TRACE_RELEASE_HOLD = 18,
+};
+
+struct TraceRecord {
+    int kind;
+    // Of the dual-role key for the decisions.
+    KeyCode key_code;
+    // `NO_TIME` for untimed events.
+    Timestamp time;
+};
+
+// About a million records.
+const std::size_t DEFAULT_TRACE_CAPACITY = 4 << 20;
+
+
+class TraceWriter {
+public:
+    TraceWriter() {}
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+    ~TraceWriter();
+
+    // Creates (or replaces) `path` with room for about `capacity` bytes of records.
+    bool open(const std::string& path, std::size_t capacity = DEFAULT_TRACE_CAPACITY);
+
+    // An event as given to `Engine::process_event`.
+    void record_event(int event_type, KeyCode key_code, Timestamp time) {
+        if (event_type >= KEY_PRESS && event_type <= BUTTON_RELEASE) {
+            record(event_type, key_code, time);
+        }
+    }
+
+    // Decisions carry the time of the last event (also when the hold timer has committed the hold).
+    void record_decision(TraceRecordKind kind, KeyCode key_code) {
+        record(kind, key_code, last_time_);
+    }
+
+private:
+    unsigned char* map_ = nullptr;
+    std::size_t map_size_ = 0;
+    std::uint32_t block_count_ = 0;
+    // The block being filled, its fill level and the time of its last record.
+    std::uint32_t block_ = 0;
+    std::uint32_t used_ = 0;
+    Timestamp block_time_ = NO_TIME;
+    std::uint64_t sequence_ = 0;
+    Timestamp last_time_ = NO_TIME;
+
+private:
+    void record(int kind, KeyCode key_code, Timestamp time);
+    void start_block(Timestamp time);
+};
+
+
+// Reads the records still in the ring file at `path`, oldest first; reports failures to `std::cerr`.
+bool read_trace(const std::string& path, std::vector<TraceRecord>& records);
+
+
+#endif  // SPACE2SUPER_TRACE_H
@@ -0,0 +1,62 @@
+#include "trace_replay.h"
+
+
+namespace {
+
+// Shift, Control, Alt and Super on either side.
+const KeyCode MODIFIER_KEY_CODES[] = {50, 62, 37, 105, 64, 108, 133, 134};
+
+}  // namespace
+
+
+TraceReplay::TraceReplay(KeyCode space_key_code, int timeout_millisec, const EngineOptions& options):
+    engine_(space_key_code, timeout_millisec, *this, *this, options)
+{
+    for (KeyCode key_code : MODIFIER_KEY_CODES) {
+        engine_.set_modifier_key(key_code, true);
+    }
+}
+
+void TraceReplay::feed(const TraceRecord& record) {
+    if (record.kind < KEY_PRESS || record.kind > BUTTON_RELEASE) {
+        return;
+    }
+    // As in the daemons, an event already there when the timer goes off wins over it.
+    if (hold_deadline_ != NO_TIME && record.time != NO_TIME && hold_deadline_ < record.time) {
+        commit_hold();
+    }
+    if (record.time != NO_TIME) {
+        now_ = record.time;
+    }
+    engine_.process_event(record.kind, record.key_code, record.time);
+}
+
+void TraceReplay::commit_hold() {
+    if (hold_deadline_ == NO_TIME) {
+        return;
+    }
+    now_ = hold_deadline_;
+    hold_deadline_ = NO_TIME;
+    engine_.commit_hold();
+}
+
+const char* trace_record_kind_name(int kind) {
+    switch (kind) {
+    case KEY_PRESS:
+        return "key-press";
+    case KEY_RELEASE:
+        return "key-release";
+    case BUTTON_PRESS:
+        return "button-press";
+    case BUTTON_RELEASE:
+        return "button-release";
+    case TRACE_TAP:
+        return "tap";
+    case TRACE_HOLD:
+        return "hold";
+    case TRACE_RELEASE_HOLD:
+        return "release-hold";
+    default:
+        return "unknown";
+    }
+}
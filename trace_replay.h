@@ -0,0 +1,79 @@
+#ifndef SPACE2SUPER_TRACE_REPLAY_H
+#define SPACE2SUPER_TRACE_REPLAY_H
+
+#include <vector>
+
+#include "engine.h"
+#include "trace.h"
+
+
+// Feeds recorded events (see `trace.h`) to an engine the way the daemons do, with the hold timer
+// going off on the trace timeline, and collects the decisions it makes as trace records.
+// The standard modifier key codes (the same in X and evdev terms) are marked for the engine,
+// since the traces do not tell them.
+class TraceReplay: private Clock, private Output {
+public:
+    TraceReplay(KeyCode space_key_code, int timeout_millisec, const EngineOptions& options = EngineOptions());
+
+    // Lets an overdue hold timer go off first; the recorded decisions are skipped.
+    void feed(const TraceRecord& record);
+
+    // When the hold timer requested by the engine goes off, or `NO_TIME`.
+    Timestamp hold_deadline() const {
+        return hold_deadline_;
+    }
+
+    // The hold timer going off.
+    void commit_hold();
+
+    // The time of the untimed events and the decisions, otherwise that of the last event.
+    void set_now(Timestamp moment) {
+        now_ = moment;
+    }
+
+    const std::vector<TraceRecord>& decisions() const {
+        return decisions_;
+    }
+
+    const Engine& engine() const {
+        return engine_;
+    }
+
+private:
+    Engine engine_;
+    Timestamp now_ = 0;
+    Timestamp hold_deadline_ = NO_TIME;
+    std::vector<TraceRecord> decisions_;
+
+private:
+    Timestamp now() override {
+        return now_;
+    }
+
+    void tap(const DualRoleKey& key) override {
+        decisions_.push_back({TRACE_TAP, key.key_code, now_});
+    }
+
+    void hold(const DualRoleKey& key) override {
+        decisions_.push_back({TRACE_HOLD, key.key_code, now_});
+    }
+
+    void release_hold(const DualRoleKey& key) override {
+        decisions_.push_back({TRACE_RELEASE_HOLD, key.key_code, now_});
+    }
+
+    void schedule_hold(Timestamp microseconds) override {
+        hold_deadline_ = now_ + microseconds;
+    }
+
+    void cancel_hold() override {
+        hold_deadline_ = NO_TIME;
+    }
+};
+
+
+// `tap`, `hold`, `release-hold`, or the event type name for the other record kinds.
+const char* trace_record_kind_name(int kind);
+
+
+#endif  // SPACE2SUPER_TRACE_REPLAY_H
@@ -0,0 +1,16 @@
+#include "x_error.h"
+
+#include <iostream>
+
+
+std::atomic<int> x_error_count{0};
+
+int report_x_error(Display* display, XErrorEvent* error) {
+    char description[256];
+    XGetErrorText(display, error->error_code, description, sizeof(description));
+    std::cerr << "X error: " << description <<
+        " (request " << static_cast<int>(error->request_code) << "." << static_cast<int>(error->minor_code) <<
+        ", serial " << error->serial << ")." << std::endl;
+    ++x_error_count;
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef SPACE2SUPER_X_ERROR_H
+#define SPACE2SUPER_X_ERROR_H
+
+#include <atomic>
+
+#include <X11/Xlib.h>
+
+
+// The number of X protocol errors reported so far (from any thread).
+extern std::atomic<int> x_error_count;
+
+// The Xlib connections are not synchronized (that would make each request a round trip),
+// so errors arrive asynchronously and are only reported rather than being fatal.
+int report_x_error(Display* display, XErrorEvent* error);
+
+
+#endif  // SPACE2SUPER_X_ERROR_H
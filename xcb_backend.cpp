@@ -0,0 +1,170 @@
+#include "xcb_backend.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <xcb/xcbext.h>
+#include <X11/extensions/recordconst.h>
+
+
+namespace {
+
+void report_xcb_error(const char* action, const xcb_generic_error_t& error) {
+    std::cerr << action << " failed with X error " << static_cast<int>(error.error_code) <<
+        " (request " << static_cast<int>(error.major_code) << "." << error.minor_code << ")." << std::endl;
+}
+
+}  // namespace
+
+
+XcbBackend::~XcbBackend() {
+    if (record_context_ != 0) {
+        if (recording_) {
+            xcb_record_disable_context(control_connection_, record_context_);
+        }
+        xcb_record_free_context(control_connection_, record_context_);
+        xcb_flush(control_connection_);
+    }
+    if (data_connection_ != nullptr) {
+        xcb_disconnect(data_connection_);
+    }
+    if (control_connection_ != nullptr) {
+        xcb_disconnect(control_connection_);
+    }
+}
+
+bool XcbBackend::connect(xcb_connection_t*& connection) {
+    connection = xcb_connect(/* displayname */ nullptr, /* screenp */ nullptr);  // $DISPLAY by default.
+    if (xcb_connection_has_error(connection)) {
+        std::cerr << "Could not open the default display (not running under X11?)." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool XcbBackend::check_xrecord_extension() {
+    const xcb_query_extension_reply_t* extension = xcb_get_extension_data(control_connection_, &xcb_record_id);
+    xcb_record_query_version_reply_t* version = nullptr;
+    if (extension != nullptr && extension->present) {
+        version = xcb_record_query_version_reply(
+            control_connection_,
+            xcb_record_query_version(control_connection_, XCB_RECORD_MAJOR_VERSION, XCB_RECORD_MINOR_VERSION),
+            /* error */ nullptr
+        );
+    }
+    if (version == nullptr) {
+        std::cerr <<
+            "The XRecord extension has not been loaded by the X server.\n" <<
+            "Try adding the following line:\n"
+            "     Load    \"record\"\n"
+            "into the `Module` section of /etc/X11/xorg.conf." <<
+            std::endl;
+        return false;
+    }
+    free(version);
+    return true;
+}
+
+bool XcbBackend::create_context() {
+    xcb_record_client_spec_t client_spec = XCB_RECORD_CS_ALL_CLIENTS;
+
+    xcb_record_range_t range;
+    std::memset(&range, 0, sizeof(range));
+    range.device_events.first = XCB_KEY_PRESS;
+    range.device_events.last = XCB_BUTTON_RELEASE;
+
+    record_context_ = xcb_generate_id(control_connection_);
+    xcb_generic_error_t* error = xcb_request_check(
+        control_connection_,
+        xcb_record_create_context_checked(
+            control_connection_, record_context_, /* element_header */ 0,
+            /* num_client_specs */ 1, /* num_ranges */ 1, &client_spec, &range
+        )
+    );
+    if (error != nullptr) {
+        report_xcb_error("Creating a record context", *error);
+        free(error);
+        record_context_ = 0;
+        return false;
+    }
+    return true;
+}
+
+bool XcbBackend::start(EventSink& sink) {
+    sink_ = &sink;
+
+    if (! connect(control_connection_) ||
+        ! connect(data_connection_) ||
+        ! check_xrecord_extension() ||
+        ! create_context())
+    {
+        return false;
+    }
+
+    enable_cookie_ = xcb_record_enable_context(data_connection_, record_context_);
+    xcb_flush(data_connection_);
+    recording_ = true;
+    return true;
+}
+
+int XcbBackend::fd() const {
+    return xcb_get_file_descriptor(data_connection_);
+}
+
+void XcbBackend::process() {
+    // Returns 0 once everything that has been read is delivered, without blocking.
+    void* reply;
+    xcb_generic_error_t* error;
+    while (recording_ &&
+           xcb_poll_for_reply(data_connection_, enable_cookie_.sequence, &reply, &error))
+    {
+        if (error != nullptr) {
+            report_xcb_error("Recording", *error);
+            free(error);
+        }
+        if (reply == nullptr) {
+            // The request has completed without a reply: nothing more will be recorded.
+            recording_ = false;
+            sink_->end_of_data();
+            return;
+        }
+        dispatch(*static_cast<const xcb_record_enable_context_reply_t*>(reply));
+        free(reply);
+    }
+}
+
+void XcbBackend::dispatch(const xcb_record_enable_context_reply_t& reply) {
+    switch (reply.category) {
+    case XRecordFromServer:
+        break;
+    case XRecordEndOfData:
+        // Confirms `xcb_record_disable_context`.
+        recording_ = false;
+        sink_->end_of_data();
+        return;
+    default:
+        return;
+    }
+
+    // The data is a sequence of 32-byte wire events (no element headers were requested),
+    // and all the recorded device events share the key press layout.
+    const std::uint8_t* data = xcb_record_enable_context_data(&reply);
+    int length = xcb_record_enable_context_data_length(&reply);
+    for (int offset = 0; offset + static_cast<int>(sizeof(xcb_key_press_event_t)) <= length;
+         offset += sizeof(xcb_key_press_event_t))
+    {
+        const auto& event = *reinterpret_cast<const xcb_key_press_event_t*>(data + offset);
+        sink_->record_event(event.response_type & ~0x80, event.detail, event.time);
+    }
+}
+
+bool XcbBackend::request_stop() {
+    if (! recording_) {
+        return false;
+    }
+    xcb_record_disable_context(control_connection_, record_context_);
+    xcb_flush(control_connection_);
+    return true;
+}
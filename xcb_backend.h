@@ -0,0 +1,42 @@
+#ifndef SPACE2SUPER_XCB_BACKEND_H
+#define SPACE2SUPER_XCB_BACKEND_H
+
+#include <xcb/xcb.h>
+#include <xcb/record.h>
+
+#include "backend.h"
+
+
+// Records the device events of all the clients with XCB, walking the reply buffers in place:
+// the server may batch several events into one reply, and no per-event allocation is made.
+class XcbBackend: public Backend {
+public:
+    ~XcbBackend();
+
+    bool start(EventSink& sink) override;
+    int fd() const override;
+    void process() override;
+    bool request_stop() override;
+
+private:
+    EventSink* sink_ = nullptr;
+
+    // Same as with `XRecordBackend`: the data connection is dedicated to the recorded replies.
+    xcb_connection_t* control_connection_ = nullptr;
+    xcb_connection_t* data_connection_ = nullptr;
+
+    xcb_record_context_t record_context_ = 0;
+    // All the recorded data comes as replies to this one request.
+    xcb_record_enable_context_cookie_t enable_cookie_;
+    // Whether the record context is enabled (until the XRecord end of data arrives).
+    bool recording_ = false;
+
+private:
+    bool connect(xcb_connection_t*& connection);
+    bool check_xrecord_extension();
+    bool create_context();
+    void dispatch(const xcb_record_enable_context_reply_t& reply);
+};
+
+
+#endif  // SPACE2SUPER_XCB_BACKEND_H
@@ -0,0 +1,191 @@
+#include "xinput_backend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <X11/extensions/XInput2.h>
+
+
+namespace {
+
+// Raw events are only delivered to root window selections regardless of grabs since XInput 2.1.
+const int XINPUT_MAJOR_VERSION = 2;
+const int XINPUT_MINOR_VERSION = 1;
+
+}  // namespace
+
+
+bool XInputBackend::check_xinput_extension() {
+    int unused;
+    if (! XQueryExtension(display_.get(), "XInputExtension", &xinput_opcode_, &unused, &unused)) {
+        std::cerr << "The XInput extension has not been loaded by the X server." << std::endl;
+        return false;
+    }
+
+    int major = XINPUT_MAJOR_VERSION;
+    int minor = XINPUT_MINOR_VERSION;
+    if (XIQueryVersion(display_.get(), &major, &minor) != Success ||
+        major < XINPUT_MAJOR_VERSION || (major == XINPUT_MAJOR_VERSION && minor < XINPUT_MINOR_VERSION))
+    {
+        std::cerr << "The X server supports XInput " << major << "." << minor <<
+            " only, at least " << XINPUT_MAJOR_VERSION << "." << XINPUT_MINOR_VERSION << " is needed." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool XInputBackend::start(EventSink& sink) {
+    sink_ = &sink;
+
+    display_.reset(XOpenDisplay(/* display_name */ nullptr));  // $DISPLAY by default.
+    if (display_ == nullptr) {
+        std::cerr << "Could not open the default display (not running under X11?)." << std::endl;
+        return false;
+    }
+
+    if (! check_xinput_extension()) {
+        return false;
+    }
+
+    // Master devices only: every slave event is duplicated by its master.
+    select_raw_events(XIAllMasterDevices);
+    return true;
+}
+
+void XInputBackend::select_raw_events(int device_id) {
+    unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)];
+    std::memset(mask_bits, 0, sizeof(mask_bits));
+    XISetMask(mask_bits, XI_RawKeyPress);
+    XISetMask(mask_bits, XI_RawKeyRelease);
+    XISetMask(mask_bits, XI_RawButtonPress);
+    XISetMask(mask_bits, XI_RawButtonRelease);
+
+    XIEventMask mask;
+    mask.deviceid = device_id;
+    mask.mask_len = sizeof(mask_bits);
+    mask.mask = mask_bits;
+
+    XISelectEvents(display_.get(), DefaultRootWindow(display_.get()), &mask, /* num_masks */ 1);
+    XFlush(display_.get());
+}
+
+int XInputBackend::fd() const {
+    return ConnectionNumber(display_.get());
+}
+
+void XInputBackend::process() {
+    while (XPending(display_.get()) > 0) {
+        XEvent event;
+        XNextEvent(display_.get(), &event);
+
+        XGenericEventCookie& cookie = event.xcookie;
+        if (cookie.type != GenericEvent || cookie.extension != xinput_opcode_ ||
+            ! XGetEventData(display_.get(), &cookie))
+        {
+            continue;
+        }
+
+        const XIRawEvent& raw_event = *static_cast<const XIRawEvent*>(cookie.data);
+        const XIDeviceEvent& device_event = *static_cast<const XIDeviceEvent*>(cookie.data);
+        int event_type = 0;
+        switch (cookie.evtype) {
+        case XI_RawKeyPress:
+            event_type = KEY_PRESS;
+            break;
+        case XI_RawKeyRelease:
+            event_type = KEY_RELEASE;
+            break;
+        case XI_RawButtonPress:
+            event_type = BUTTON_PRESS;
+            break;
+        case XI_RawButtonRelease:
+            event_type = BUTTON_RELEASE;
+            break;
+        // Only delivered by the grabs.
+        case XI_KeyPress:
+        case XI_KeyRelease:
+            sink_->grabbed_event(
+                cookie.evtype == XI_KeyPress ? KEY_PRESS : KEY_RELEASE, static_cast<KeyCode>(device_event.detail),
+                (device_event.flags & XIKeyRepeat) != 0
+            );
+            break;
+        }
+        // When grabbing, the slave events come in their own right and again through their master (if attached),
+        // so only the former count.
+        if (event_type != 0 && ! is_xtest_device(raw_event.sourceid) &&
+            (! grabbing_ || raw_event.deviceid == raw_event.sourceid))
+        {
+            sink_->record_event(event_type, static_cast<KeyCode>(raw_event.detail), raw_event.time);
+        }
+
+        XFreeEventData(display_.get(), &cookie);
+    }
+}
+
+bool XInputBackend::is_xtest_device(int device_id) const {
+    return std::find(xtest_device_ids_.begin(), xtest_device_ids_.end(), device_id) != xtest_device_ids_.end();
+}
+
+bool XInputBackend::grab_keys(const std::vector<KeyCode>& key_codes) {
+    int device_count = 0;
+    XIDeviceInfo* devices = XIQueryDevice(display_.get(), XIAllDevices, &device_count);
+    if (devices == nullptr) {
+        std::cerr << "Could not list the input devices." << std::endl;
+        return false;
+    }
+
+    unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)];
+    std::memset(mask_bits, 0, sizeof(mask_bits));
+    XISetMask(mask_bits, XI_KeyPress);
+    XISetMask(mask_bits, XI_KeyRelease);
+
+    XIEventMask mask;
+    mask.deviceid = XIAllDevices;  // Ignored, the grabbed device is given separately.
+    mask.mask_len = sizeof(mask_bits);
+    mask.mask = mask_bits;
+
+    // An active grab detaches the keyboard from its master until the key is released, so its raw events
+    // (the release of the dual-role key and the keys pressed meanwhile above all) no longer come through
+    // the master: they are selected on the slaves from now on, leaving out the XTest ones (see `process`).
+    grabbing_ = true;
+    select_raw_events(XIAllDevices);
+
+    // Slave devices only: the keys injected by XTest through the same master must still reach the clients.
+    int keyboard_count = 0;
+    for (int index = 0; index < device_count; ++index) {
+        const XIDeviceInfo& device = devices[index];
+        if (device.use != XISlaveKeyboard) {
+            continue;
+        }
+        if (std::strstr(device.name, "XTEST") != nullptr) {
+            xtest_device_ids_.push_back(device.deviceid);
+            continue;
+        }
+        for (KeyCode key_code : key_codes) {
+            XIGrabModifiers modifiers = {static_cast<int>(XIAnyModifier), 0};
+            if (XIGrabKeycode(
+                    display_.get(), device.deviceid, key_code, DefaultRootWindow(display_.get()),
+                    XIGrabModeAsync, XIGrabModeAsync, /* owner_events */ False, &mask, /* num_modifiers */ 1, &modifiers
+                ) != 0)
+            {
+                std::cerr << "Could not grab key code " << static_cast<int>(key_code) <<
+                    " on `" << device.name << "`." << std::endl;
+            }
+        }
+        ++keyboard_count;
+    }
+    XIFreeDeviceInfo(devices);
+    XFlush(display_.get());
+
+    if (keyboard_count == 0) {
+        std::cerr << "No keyboard to grab the keys on." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool XInputBackend::request_stop() {
+    // Nothing to wait for: the selection goes away with the connection.
+    return false;
+}
@@ -0,0 +1,54 @@
+#ifndef SPACE2SUPER_XINPUT_BACKEND_H
+#define SPACE2SUPER_XINPUT_BACKEND_H
+
+#include <memory>
+#include <vector>
+
+#include <X11/Xlib.h>
+
+#include "backend.h"
+
+
+// Observes the raw device events with XInput 2 (`XI_RawKeyPress` etc. selected on the root window),
+// which works on X servers without the XRecord extension.
+// It can also grab keys, leaving out the raw events of the keys injected meanwhile with XTest.
+// The raw events of a grabbed keyboard still reach `EventSink::record_event` while it is detached
+// from its master by the grab, in particular the release ending the grab, since they are then
+// selected on the slave devices themselves.
+class XInputBackend: public Backend {
+public:
+    bool start(EventSink& sink) override;
+    int fd() const override;
+    void process() override;
+    bool request_stop() override;
+    bool grab_keys(const std::vector<KeyCode>& key_codes) override;
+
+private:
+    class DisplayCloser {
+    public:
+        void operator()(Display* display) {
+            XCloseDisplay(display);
+        }
+    };
+
+    typedef std::unique_ptr<Display, DisplayCloser> DisplayPointer;
+
+private:
+    EventSink* sink_ = nullptr;
+    DisplayPointer display_;
+    // Identifies the XInput generic events.
+    int xinput_opcode_ = 0;
+    // The XTest slave keyboards, known once grabbing.
+    std::vector<int> xtest_device_ids_;
+    // Whether the raw events are selected on all devices rather than on the masters, see `grab_keys`.
+    bool grabbing_ = false;
+
+private:
+    bool check_xinput_extension();
+    // Selects the raw key and button events of `device_id` (or `XIAllDevices` etc.) on the root window.
+    void select_raw_events(int device_id);
+    bool is_xtest_device(int device_id) const;
+};
+
+
+#endif  // SPACE2SUPER_XINPUT_BACKEND_H
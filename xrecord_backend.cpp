@@ -0,0 +1,160 @@
+#include "xrecord_backend.h"
+
+#include <iostream>
+#include <type_traits>
+
+#include <X11/Xlibint.h>
+
+// Defined in Xlibint.h.
+#undef min
+#undef max
+
+#include "log.h"
+#include "x_error.h"
+
+
+namespace {
+
+class XObjectDestructor {
+public:
+    void operator()(void* object) {
+        XFree(object);
+    }
+};
+
+class XRecordInterceptDataDestructor {
+public:
+    void operator()(XRecordInterceptData* intercept_data) {
+        XRecordFreeData(intercept_data);
+    }
+};
+
+}  // namespace
+
+
+XRecordBackend::~XRecordBackend() {
+    if (record_context_ == 0) {
+        return;
+    }
+    if (recording_ && ! XRecordDisableContext(control_display_.get(), record_context_)) {
+        std::cerr << "Couldn't disable the record context." << std::endl;
+    }
+    XRecordFreeContext(control_display_.get(), record_context_);
+}
+
+bool XRecordBackend::check_xrecord_extension() const {
+    int unused;
+    if (! XRecordQueryVersion(control_display_.get(), &unused, &unused)) {
+        std::cerr <<
+            "The XRecord extension has not been loaded by the X server.\n" <<
+            "Try adding the following line:\n"
+            "     Load    \"record\"\n"
+            "into the `Module` section of /etc/X11/xorg.conf." <<
+            std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool XRecordBackend::create_context() {
+    XRecordClientSpec record_client_spec = XRecordAllClients;
+    XRecordClientSpec record_client_specs[] = {record_client_spec};
+
+    std::unique_ptr<XRecordRange, XObjectDestructor> record_range{XRecordAllocRange()};
+    if (record_range == nullptr) {
+        std::cerr << "Could not allocate a record range object (XRecordRange)." << std::endl;
+        return false;
+    }
+    record_range->device_events.first = KeyPress;
+    record_range->device_events.last = ButtonRelease;
+    XRecordRange* record_ranges[] = {record_range.get()};
+
+    record_context_ = XRecordCreateContext(
+        control_display_.get(), /* datum_flags */ 0 /* disable all options */,
+        record_client_specs, /* nclients */ std::extent<decltype(record_client_specs)>::value,
+        record_ranges, /* n_ranges */ std::extent<decltype(record_ranges)>::value
+    );
+
+    if (record_context_ == 0) {
+        std::cerr << "Could not create a record context (XRecordContext)." << std::endl;
+        return false;
+    }
+
+    // The only deliberate round trip: make sure the context exists before enabling it.
+    int errors_before = x_error_count;
+    XSync(control_display_.get(), /* discard */ False);
+    if (x_error_count != errors_before) {
+        std::cerr << "Could not create a record context (XRecordContext)." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool XRecordBackend::start(EventSink& sink) {
+    sink_ = &sink;
+
+    control_display_.reset(XOpenDisplay(/* display_name */ nullptr));  // $DISPLAY by default.
+    data_display_.reset(XOpenDisplay(/* display_name */ nullptr));
+    if (control_display_ == nullptr || data_display_ == nullptr) {
+        std::cerr << "Could not open the XRecord connections to the default display." << std::endl;
+        return false;
+    }
+
+    if (! check_xrecord_extension() || ! create_context()) {
+        return false;
+    }
+
+    // Unlike `XRecordEnableContext`, returns immediately; the recorded data is then
+    // dispatched to `event_callback` by `XRecordProcessReplies` whenever it arrives.
+    auto status = XRecordEnableContextAsync(
+        data_display_.get(), record_context_, event_callback, reinterpret_cast<XPointer>(this)
+    );
+    if (status == 0) {
+        std::cerr << "Couldn't enable the record context." << std::endl;
+        return false;
+    }
+    XFlush(data_display_.get());
+    recording_ = true;
+    return true;
+}
+
+int XRecordBackend::fd() const {
+    return ConnectionNumber(data_display_.get());
+}
+
+void XRecordBackend::process() {
+    XRecordProcessReplies(data_display_.get());
+}
+
+bool XRecordBackend::request_stop() {
+    if (! recording_) {
+        return false;
+    }
+    if (! XRecordDisableContext(control_display_.get(), record_context_)) {
+        std::cerr << "Couldn't disable the record context." << std::endl;
+        return false;
+    }
+    XFlush(control_display_.get());
+    return true;
+}
+
+void XRecordBackend::event_callback(XPointer callback_closure, XRecordInterceptData* intercept_data) {
+    std::unique_ptr<XRecordInterceptData, XRecordInterceptDataDestructor> data{intercept_data};
+
+    auto self = reinterpret_cast<XRecordBackend*>(callback_closure);
+
+    if (data->category == XRecordEndOfData) {
+        // Confirms `XRecordDisableContext`.
+        self->recording_ = false;
+        self->sink_->end_of_data();
+        return;
+    }
+
+    if (data->category != XRecordFromServer) {
+        return;
+    }
+
+    const xEvent& event = *reinterpret_cast<xEvent*>(intercept_data->data);
+    const auto& generic_event = event.u.u;
+    self->sink_->record_event(generic_event.type, generic_event.detail, event.u.keyButtonPointer.time);
+}
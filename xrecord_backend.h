@@ -0,0 +1,56 @@
+#ifndef SPACE2SUPER_XRECORD_BACKEND_H
+#define SPACE2SUPER_XRECORD_BACKEND_H
+
+#include <memory>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/record.h>
+
+#include "backend.h"
+
+
+// Records the device events of all the clients with the Xlib XRecord API.
+class XRecordBackend: public Backend {
+public:
+    ~XRecordBackend();
+
+    bool start(EventSink& sink) override;
+    int fd() const override;
+    void process() override;
+    bool request_stop() override;
+
+private:
+    class DisplayCloser {
+    public:
+        void operator()(Display* display) {
+            XCloseDisplay(display);
+        }
+    };
+
+    typedef std::unique_ptr<Display, DisplayCloser> DisplayPointer;
+
+private:
+    EventSink* sink_ = nullptr;
+
+    // See Section 1.3 of the XRecord API specification which recommends to open two connections
+    // and directs which connection is typically used with each XRecord API call
+    // (presumably because of the blocking nature of `XRecordEnableContext`.
+    // A control connection to the X Server ("for recording control").
+    DisplayPointer control_display_;
+    // A data connection to the X Server ("for reading recorded protocol data").
+    DisplayPointer data_display_;
+
+    XRecordContext record_context_ = 0;
+    // Whether the record context is enabled (until the XRecord end of data arrives).
+    bool recording_ = false;
+
+private:
+    bool check_xrecord_extension() const;
+    bool create_context();
+
+    // Called from `XRecordProcessReplies` for every recorded event.
+    static void event_callback(XPointer callback_closure, XRecordInterceptData* intercept_data);
+};
+
+
+#endif  // SPACE2SUPER_XRECORD_BACKEND_H